@@ -0,0 +1,82 @@
+#include "ConvolutionReverb.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+ConvolutionReverb::ConvolutionReverb(std::vector< float > const &left, std::vector< float > const &right, uint32_t block_, MixKernel const &kernel)
+	: block(block_), fft(2 * block_, kernel), complex_multiply_add(kernel.complex_multiply_add) {
+	stride = (fft.bins() + 7) & ~7u;
+
+	std::vector< float > const &right_ = (right.empty() ? left : right);
+	size_t length = std::max(left.size(), right_.size());
+	partitions = std::max< uint32_t >(1, uint32_t((length + block - 1) / block));
+
+	//transform each partition of the impulse responses:
+	std::vector< float > padded(2 * block);
+	for (uint32_t ear = 0; ear < 2; ++ear) {
+		std::vector< float > const &response = (ear == 0 ? left : right_);
+		impulse[ear].assign(size_t(partitions) * 2 * stride, 0.0f);
+		for (uint32_t p = 0; p < partitions; ++p) {
+			std::fill(padded.begin(), padded.end(), 0.0f);
+			size_t begin = std::min(response.size(), size_t(p) * block);
+			size_t end = std::min(response.size(), begin + block);
+			std::copy(response.begin() + begin, response.begin() + end, padded.begin());
+			float *spectrum = impulse[ear].data() + size_t(p) * 2 * stride;
+			fft.forward(padded.data(), spectrum, spectrum + stride);
+		}
+	}
+
+	delay_line.assign(size_t(partitions) * 2 * stride, 0.0f);
+	history.assign(2 * block, 0.0f);
+	sum_re.assign(stride, 0.0f);
+	sum_im.assign(stride, 0.0f);
+	time.assign(2 * block, 0.0f);
+	silent_blocks = partitions + 1;
+}
+
+void ConvolutionReverb::reset() {
+	std::fill(delay_line.begin(), delay_line.end(), 0.0f);
+	std::fill(history.begin(), history.end(), 0.0f);
+	silent_blocks = partitions + 1;
+}
+
+void ConvolutionReverb::process(float const *input, float *output) {
+	bool silent = std::all_of(input, input + block, [](float f){ return f == 0.0f; });
+	if (silent) {
+		if (silent_blocks > partitions) {
+			//delay line holds only silence (every slot's [previous, current] blocks were silent):
+			std::fill(output, output + 2 * block, 0.0f);
+			return;
+		}
+		silent_blocks += 1;
+	} else {
+		silent_blocks = 0;
+	}
+
+	//transform [previous block, this block] into the next delay line slot:
+	std::copy(history.begin() + block, history.end(), history.begin());
+	std::copy(input, input + block, history.begin() + block);
+	newest = (newest + 1 == partitions ? 0 : newest + 1);
+	float *spectrum = delay_line.data() + size_t(newest) * 2 * stride;
+	fft.forward(history.data(), spectrum, spectrum + stride);
+	//(the padding past fft.bins() is never written, so stays zero)
+
+	for (uint32_t ear = 0; ear < 2; ++ear) {
+		std::fill(sum_re.begin(), sum_re.end(), 0.0f);
+		std::fill(sum_im.begin(), sum_im.end(), 0.0f);
+		//input from 'p' blocks ago meets partition 'p' of the impulse response:
+		uint32_t slot = newest;
+		for (uint32_t p = 0; p < partitions; ++p) {
+			float const *x = delay_line.data() + size_t(slot) * 2 * stride;
+			float const *h = impulse[ear].data() + size_t(p) * 2 * stride;
+			complex_multiply_add(x, x + stride, h, h + stride, stride, sum_re.data(), sum_im.data());
+			slot = (slot == 0 ? partitions - 1 : slot - 1);
+		}
+
+		//the first half of the (circular) result is wrapped-around garbage; the second half is this block's output:
+		fft.inverse(sum_re.data(), sum_im.data(), time.data());
+		for (uint32_t i = 0; i < block; ++i) {
+			output[2 * i + ear] = time[block + i];
+		}
+	}
+}
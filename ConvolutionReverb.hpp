@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ * ConvolutionReverb convolves a mono signal with a stereo impulse response
+ *  (e.g., a recording of a room), a block at a time.
+ *
+ * It uses uniformly-partitioned overlap-save FFT convolution:
+ *  the impulse response is cut into partitions of 'block' frames, each of which is
+ *  transformed (zero-padded to 2*block frames) up front, when the reverb is made.
+ *  Each block of input is transformed once -- along with the block before it -- and kept
+ *  in a frequency-domain delay line; the output is then the inverse transform of
+ *  sum_p input_spectrum[now - p] * partition_spectrum[p], of which the last 'block' frames are valid.
+ *
+ * So a block costs one forward and two inverse FFTs whatever the impulse response's length,
+ *  plus one (SIMD) complex multiply-add per partition per channel; and nothing at all once
+ *  the input has been silent for longer than the impulse response.
+ *
+ */
+
+#include "RealFFT.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct ConvolutionReverb {
+	//'left' and 'right' are the impulse responses for each ear (48kHz); if 'right' is empty, 'left' is used for both.
+	// 'block' is the number of frames process() takes at once (a power of two, at least 4; throws otherwise):
+	ConvolutionReverb(std::vector< float > const &left, std::vector< float > const &right, uint32_t block, MixKernel const &kernel = get_mix_kernel());
+
+	uint32_t block;
+	uint32_t partitions; //impulse response length, in blocks
+
+	//convolve 'block' frames of (mono) 'input', writing 'block' frames of stereo (LRLR...) to 'output':
+	void process(float const *input, float *output);
+
+	//forget all past input (cutting off the reverb tail):
+	void reset();
+
+	//------ internals ------
+	RealFFT fft;
+	ComplexMultiplyAddFn complex_multiply_add;
+	uint32_t stride; //floats per spectrum part: fft.bins() rounded up to a multiple of 8 (so the SIMD kernels need no remainder loop)
+
+	//spectra are stored as 'stride' real parts followed by 'stride' imaginary parts:
+	std::vector< float > impulse[2]; //[ear]: 'partitions' spectra of impulse response partitions
+	std::vector< float > delay_line; //'partitions' spectra of recent input, as a ring buffer
+	uint32_t newest = 0; //slot in delay_line of the most recent input
+
+	uint32_t silent_blocks = 0; //blocks of all-zero input in a row (once this passes 'partitions', output is silent too)
+
+	std::vector< float > history; //(2*block) the previous and current input blocks
+	std::vector< float > sum_re, sum_im; //('stride' each) output spectrum being accumulated
+	std::vector< float > time; //(2*block) inverse transform of sum
+};
@@ -121,7 +121,22 @@ const game_names = [
 	//maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
 	maek.CPP('Sound.cpp'),
 	maek.CPP('load_wav.cpp'),
-	maek.CPP('load_opus.cpp')
+	maek.CPP('load_opus.cpp'),
+	maek.CPP('OpusStream.cpp'),
+	maek.CPP('pcm_cache.cpp'),
+	maek.CPP('adpcm.cpp'),
+	maek.CPP('SpectrumAnalyzer.cpp')
+];
+
+const mix_kernel_names = [
+	maek.CPP('mix_kernel.cpp')
+];
+
+//audio code shared by the game and bench-mix (each object may only be built by one rule):
+const audio_dsp_names = [
+	maek.CPP('RealFFT.cpp'),
+	maek.CPP('ConvolutionReverb.cpp'),
+	maek.CPP('ModalSynth.cpp')
 ];
 
 const common_names = [
@@ -136,7 +151,9 @@ const common_names = [
 	maek.CPP('gl_compile_program.cpp'),
 	maek.CPP('Mode.cpp'),
 	maek.CPP('GL.cpp'),
-	maek.CPP('Load.cpp')
+	maek.CPP('Load.cpp'),
+	maek.CPP('ThreadPool.cpp'),
+	maek.CPP('transform_kernel.cpp')
 ];
 
 const show_meshes_names = [
@@ -151,16 +168,26 @@ const show_scene_names = [
 	maek.CPP('ShowSceneMode.cpp')
 ];
 
+const bench_mix_names = [
+	maek.CPP('bench-mix.cpp')
+];
+
+const bench_transforms_names = [
+	maek.CPP('bench-transforms.cpp')
+];
+
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
-const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
+const game_exe = maek.LINK([...game_names, ...audio_dsp_names, ...mix_kernel_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const bench_mix_exe = maek.LINK([...bench_mix_names, ...audio_dsp_names, ...mix_kernel_names], 'bench/bench-mix');
+const bench_transforms_exe = maek.LINK([...bench_transforms_names, ...common_names], 'bench/bench-transforms');
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, bench_mix_exe, bench_transforms_exe, ...copies];
 
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
@@ -0,0 +1,101 @@
+#include "ModalSynth.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+static constexpr double const AUDIO_RATE = 48000.0;
+static constexpr double const MAX_PARTIAL_HZ = 18000.0; //(partials above this are left out, well clear of aliasing)
+
+ModalSynth::ModalSynth() : ModalSynth(Parameters()) {
+}
+
+ModalSynth::ModalSynth(Parameters const &parameters) {
+	double const pi = 3.14159265358979323846;
+	notes.resize(128);
+	for (uint32_t n = 0; n < notes.size(); ++n) {
+		Note &note = notes[n];
+		double f0 = 440.0 * std::pow(2.0, (double(n) - 69.0) / 12.0);
+		double octaves = (double(n) - 21.0) / 12.0; //(above A0)
+		double B = parameters.inharmonicity * std::pow(2.6, octaves);
+		double damping = parameters.damping * std::pow(1.6, octaves);
+		double detune = std::pow(2.0, parameters.detune / 1200.0);
+
+		//two partials (prompt sound, then aftersound) per mode, until the modes get too high:
+		uint32_t modes = 0;
+		double total = 0.0;
+		for (uint32_t m = 1; 2 * m <= MaxPartials; ++m) {
+			double hz = m * f0 * std::sqrt(1.0 + B * m * m);
+			if (hz * detune > MAX_PARTIAL_HZ) break;
+			modes = m;
+
+			double strike = std::max(0.05, std::abs(std::sin(pi * m * parameters.hammer_position)));
+			double amplitude = strike / m;
+			double decay = damping + parameters.air_damping * hz * hz;
+			for (uint32_t part = 0; part < 2; ++part) {
+				uint32_t p = 2 * (m - 1) + part;
+				double share = (part == 0 ? parameters.prompt : 1.0 - parameters.prompt);
+				double rate = (part == 0 ? decay * parameters.prompt_speed : decay);
+				double omega = 2.0 * pi * (part == 0 ? hz : hz * detune) / AUDIO_RATE;
+				double r = std::exp(-rate / AUDIO_RATE);
+				note.w_re[p] = float(r * std::cos(omega));
+				note.w_im[p] = float(r * std::sin(omega));
+				note.amplitude[p] = float(share * amplitude);
+				note.velocity_exponent[p] = float(1.0 + parameters.hardness * double(m - 1) / double(MaxPartials / 2));
+				total += double(note.amplitude[p]) * double(note.amplitude[p]);
+			}
+		}
+		note.partials = 2 * modes;
+
+		//scale so a velocity-1 note starts at the requested (rms) level:
+		double scale = (total > 0.0 ? parameters.level * std::sqrt(2.0 / total) : 0.0);
+		for (uint32_t p = 0; p < note.partials; ++p) {
+			note.amplitude[p] = float(note.amplitude[p] * scale);
+		}
+	}
+}
+
+ModalSynth::Note const &ModalSynth::start(uint8_t note, float velocity, float *z_re, float *z_im) const {
+	assert(note < notes.size());
+	Note const &table = notes[note];
+	velocity = std::max(0.0f, std::min(1.0f, velocity));
+	//(phasors start on the real axis, so each partial -- the imaginary part -- starts at zero, without a click)
+	for (uint32_t p = 0; p < table.partials; ++p) {
+		z_re[p] = table.amplitude[p] * std::pow(velocity, table.velocity_exponent[p]);
+		z_im[p] = 0.0f;
+	}
+	return table;
+}
+
+void ModalSynth::advance(Note const &note, float *z_re, float *z_im, uint64_t frames) {
+	for (uint32_t p = 0; p < note.partials; ++p) {
+		//z *= w^frames, by repeated squaring:
+		float step_re = note.w_re[p], step_im = note.w_im[p];
+		float re = z_re[p], im = z_im[p];
+		for (uint64_t remaining = frames; remaining > 0; remaining >>= 1) {
+			if (remaining & 1) {
+				float next_re = re * step_re - im * step_im;
+				im = re * step_im + im * step_re;
+				re = next_re;
+			}
+			float next_step_re = step_re * step_re - step_im * step_im;
+			step_im = 2.0f * step_re * step_im;
+			step_re = next_step_re;
+		}
+		z_re[p] = re;
+		z_im[p] = im;
+	}
+}
+
+float ModalSynth::settle(Note const &note, float *z_re, float *z_im) {
+	float sum = 0.0f;
+	for (uint32_t p = 0; p < note.partials; ++p) {
+		float power = z_re[p] * z_re[p] + z_im[p] * z_im[p];
+		if (power < 1e-20f) { //(-200dB: still far from denormal after another block of decay)
+			z_re[p] = 0.0f;
+			z_im[p] = 0.0f;
+		}
+		sum += power;
+	}
+	return sum;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * ModalSynth makes piano-like notes from nothing but a handful of numbers per note.
+ *
+ * Each note is a bank of decaying sinusoids ("partials"), one per vibrating mode of the string:
+ *  - mode n sounds at n * f0 * sqrt(1 + B n^2) -- a stiff string is slightly sharp in its upper modes;
+ *  - its strength depends on where the hammer strikes (modes with a node there are weak)
+ *    and on velocity (harder strikes are louder, and brighter);
+ *  - it dies away at a rate that grows with pitch (high partials and high notes fade first);
+ *  - it is split between a fast-decaying "prompt sound" and a slightly-detuned, slower "aftersound",
+ *    which gives the two-stage decay and gentle beating of a piano's unison strings.
+ *
+ * Each partial is a complex phasor stepped by a constant complex factor per frame, so a note
+ *  costs a complex multiply per partial per frame, done by the (SIMD) OscillatorBankFn kernel;
+ *  there is no sample data to load or store, and any MIDI note can be played.
+ *
+ */
+
+#include "mix_kernel.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct ModalSynth {
+	static constexpr uint32_t const MaxPartials = 32; //(two per mode)
+
+	struct Parameters {
+		float inharmonicity = 5e-5f; //string stiffness (B) at A0; grows by about 2.6x per octave
+		float hammer_position = 1.0f / 8.0f; //where the hammer strikes, as a fraction of the string length
+		float hardness = 1.5f; //how much brighter loud notes are than soft ones
+		float damping = 0.15f; //decay rate (per second) of the aftersound of the lowest partials at A0; grows with pitch
+		float air_damping = 8e-8f; //extra decay rate (per second) per Hz^2 of partial frequency
+		float prompt = 0.7f; //fraction of each mode in the prompt sound (which decays 'prompt_speed' times faster)
+		float prompt_speed = 4.0f;
+		float detune = 0.6f; //cents between prompt sound and aftersound
+		float level = 0.25f; //rms level of a note played at velocity 1
+	};
+	ModalSynth();
+	ModalSynth(Parameters const &parameters);
+
+	//per-note tables:
+	struct Note {
+		uint32_t partials = 0;
+		//per-frame step of each partial's phasor (decay * rotation):
+		float w_re[MaxPartials];
+		float w_im[MaxPartials];
+		//initial amplitude at velocity 1, and how fast it falls off with lower velocity:
+		float amplitude[MaxPartials];
+		float velocity_exponent[MaxPartials];
+	};
+	std::vector< Note > notes; //indexed by MIDI note number (0 - 127; 60 is middle C, 69 is A440)
+
+	//set up the phasors ('MaxPartials' each) for a new note; returns the note's table:
+	// ('velocity' is in (0,1], as in MIDI velocity / 127)
+	Note const &start(uint8_t note, float velocity, float *z_re, float *z_im) const;
+
+	//step a note's phasors forward 'frames' frames without making any sound:
+	static void advance(Note const &note, float *z_re, float *z_im, uint64_t frames);
+
+	//zero any partials that have died away (so they don't slow the oscillator bank down with denormal arithmetic),
+	// and return the sum of the partials' squared amplitudes (a note is inaudible once this is tiny):
+	static float settle(Note const &note, float *z_re, float *z_im);
+};
@@ -0,0 +1,142 @@
+#include "OpusStream.hpp"
+
+#include <opusfile.h>
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+//buffer about 1.4 seconds of audio (must be a power of two):
+static constexpr uint32_t const STREAM_BUFFER_SAMPLES = 65536;
+//decode this much before the constructor returns, so playback can start right away:
+static constexpr uint32_t const STREAM_PREFILL_SAMPLES = 4096;
+//op_read_float_stereo returns at most 120ms of audio at once:
+static constexpr uint32_t const STREAM_MAX_PACKET_SAMPLES = 5760;
+
+OpusStream::OpusStream(std::string const &filename_) : filename(filename_), op(nullptr, op_free), buffer(STREAM_BUFFER_SAMPLES) {
+	int err = 0;
+	op.reset(op_open_file(filename.c_str(), &err));
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+
+	pcm.resize(2 * STREAM_MAX_PACKET_SAMPLES);
+	pending.reserve(STREAM_MAX_PACKET_SAMPLES);
+
+	//prefill (on this thread, before the decoder thread exists):
+	while (buffer.size() < STREAM_PREFILL_SAMPLES && decode_step()) { }
+
+	decoder = std::thread(&OpusStream::decoder_thread, this);
+}
+
+OpusStream::~OpusStream() {
+	{
+		std::lock_guard< std::mutex > lock(wake_mutex);
+		quit = true;
+	}
+	wake_cv.notify_one();
+	decoder.join();
+}
+
+void OpusStream::seek(uint64_t sample) {
+	seek_target.store(sample, std::memory_order_relaxed);
+	seek_serial.fetch_add(1, std::memory_order_release);
+	wake_cv.notify_one();
+}
+
+void OpusStream::set_looping(bool looping_) {
+	looping.store(looping_, std::memory_order_relaxed);
+	wake_cv.notify_one();
+}
+
+uint32_t OpusStream::read(float *out, uint32_t count, bool wait) {
+	uint32_t total = 0;
+	for (;;) {
+		uint64_t mark = flush_mark.load(std::memory_order_acquire);
+		//if a seek hasn't been handled by the decoder yet, everything in the buffer is stale:
+		if (uint32_t(mark >> 32) == seek_serial.load(std::memory_order_acquire)) {
+			//drop anything decoded before the most recent seek:
+			if (uint32_t(mark >> 32) != reader_flush_serial) {
+				reader_flush_serial = uint32_t(mark >> 32);
+				buffer.discard_until(uint32_t(mark));
+			}
+			total += buffer.pop_many(out + total, count - total);
+		}
+		if (!wait || total == count || ended()) return total;
+		wake_cv.notify_one();
+		std::this_thread::yield();
+	}
+}
+
+bool OpusStream::ended() const {
+	if (uint32_t(flush_mark.load(std::memory_order_acquire) >> 32) != seek_serial.load(std::memory_order_acquire)) return false; //seek pending
+	return at_end.load(std::memory_order_acquire) && buffer.size() == 0;
+}
+
+//------------------------ decoder thread --------------------------------
+
+void OpusStream::handle_seek() {
+	uint32_t serial = seek_serial.load(std::memory_order_acquire);
+	if (serial == decoder_seek_serial) return;
+	decoder_seek_serial = serial;
+
+	int ret = op_pcm_seek(op.get(), ogg_int64_t(seek_target.load(std::memory_order_relaxed)));
+	if (ret != 0) {
+		std::cerr << "WARNING: opusfile error " << ret << " seeking in \"" << filename << "\"." << std::endl;
+	}
+	pending.clear();
+	pending_begin = 0;
+	at_end.store(false, std::memory_order_release);
+
+	//everything already in the buffer is from before the seek:
+	flush_mark.store((uint64_t(serial) << 32) | buffer.push_index(), std::memory_order_release);
+}
+
+bool OpusStream::decode_step() {
+	//finish pushing the previous packet first:
+	if (pending_begin < pending.size()) {
+		pending_begin += buffer.push_many(pending.data() + pending_begin, uint32_t(pending.size()) - pending_begin);
+		if (pending_begin < pending.size()) return false; //buffer is full
+	}
+
+	if (at_end.load(std::memory_order_relaxed)) return false;
+
+	int ret = op_read_float_stereo(op.get(), pcm.data(), int(pcm.size()));
+	if (ret < 0) {
+		std::cerr << "WARNING: opusfile read error " << ret << " reading \"" << filename << "\"; stopping stream." << std::endl;
+		at_end.store(true, std::memory_order_release);
+		return false;
+	}
+	if (ret == 0) {
+		if (looping.load(std::memory_order_relaxed)) {
+			int err = op_pcm_seek(op.get(), 0);
+			if (err == 0) return true;
+			std::cerr << "WARNING: opusfile error " << err << " looping \"" << filename << "\"; stopping stream." << std::endl;
+		}
+		at_end.store(true, std::memory_order_release);
+		return false;
+	}
+
+	//downmix to mono by averaging (same as load_opus):
+	pending.resize(uint32_t(ret));
+	pending_begin = 0;
+	for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+		pending[i] = (pcm[2*i] + pcm[2*i+1]) * 0.5f;
+	}
+	pending_begin += buffer.push_many(pending.data(), uint32_t(pending.size()));
+	return true;
+}
+
+void OpusStream::decoder_thread() {
+	std::unique_lock< std::mutex > lock(wake_mutex);
+	while (!quit) {
+		lock.unlock();
+		handle_seek();
+		bool more = decode_step();
+		lock.lock();
+		if (!more) {
+			//buffer full or stream over -- nap until the audio thread has used some data (or a seek/quit arrives):
+			wake_cv.wait_for(lock, std::chrono::milliseconds(10));
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+/*
+ * OpusStream decodes an opus file a little at a time, on a background thread,
+ *  so long audio (music, ambience) can play without first being decoded into memory.
+ *
+ * The decoder thread keeps a RingBuffer of (48kHz mono) samples topped up;
+ *  the audio thread takes samples out with read().
+ * Only a second or so of audio is ever held in memory.
+ *
+ */
+
+#include "RingBuffer.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct OggOpusFile;
+
+struct OpusStream {
+	//opens the file (throws on error), decodes the first few blocks, and starts the decoder thread:
+	OpusStream(std::string const &filename);
+	~OpusStream();
+
+	//------ game thread ------
+
+	//jump to sample index 'sample' (48kHz frames from the start of the file):
+	void seek(uint64_t sample);
+
+	//start over from the beginning of the file when the end is reached?
+	void set_looping(bool looping);
+
+	//------ audio thread ------
+
+	//copy up to 'count' samples into 'out'; returns the number copied.
+	// (fewer than 'count' means the decoder is behind or the stream has ended)
+	// if 'wait' is set, waits for the decoder rather than coming up short (used for offline rendering):
+	uint32_t read(float *out, uint32_t count, bool wait = false);
+
+	//true once the (non-looping) stream has played all the way through:
+	bool ended() const;
+
+	//------ internals ------
+	std::string filename; //for error messages
+	std::unique_ptr< OggOpusFile, void (*)(OggOpusFile *) > op;
+
+	RingBuffer< float > buffer; //decoded samples (decoder thread -> audio thread)
+
+	std::atomic< bool > looping{false};
+	std::atomic< bool > at_end{false}; //has the decoder run out of file (and not looped)?
+
+	//seek requests (game thread -> decoder thread):
+	std::atomic< uint64_t > seek_target{0};
+	std::atomic< uint32_t > seek_serial{0};
+	uint32_t decoder_seek_serial = 0; //last request handled by decoder thread
+
+	//after a seek, the decoder publishes (serial << 32 | buffer.push_index()) so the
+	// audio thread can throw away samples decoded before the seek:
+	std::atomic< uint64_t > flush_mark{0};
+	uint32_t reader_flush_serial = 0; //last flush handled by audio thread
+
+	//decoder thread state:
+	std::vector< float > pcm; //stereo output of op_read_float_stereo
+	std::vector< float > pending; //mono samples not yet pushed to buffer
+	uint32_t pending_begin = 0;
+
+	std::thread decoder;
+	std::mutex wake_mutex;
+	std::condition_variable wake_cv;
+	bool quit = false; //protected by wake_mutex
+
+	//decode (and push) one packet's worth of samples; returns false if the buffer is full or the stream has ended:
+	bool decode_step();
+	void handle_seek();
+	void decoder_thread();
+};
@@ -10,6 +10,8 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <random>
 
 GLuint piano_textures = 0;
@@ -44,21 +46,55 @@ Load< Sound::Sample > incorrect_sample(LoadTagDefault, []() -> Sound::Sample con
 	return new Sound::Sample(data_path("notes_incorrect.wav"));
 });
 
-Load< std::vector<Sound::Sample> > piano_key_samples(LoadTagDefault, []() -> std::vector<Sound::Sample> const * {
-	std::vector<Sound::Sample> piano;
-	std::string keys[12] = {"C4", "Cs4", "D4", "Ds4", "E4", "F4", "Fs4", "G4", "Gs4", "A4", "As4", "B4"};
-	for (std::string s: keys) {
-		piano.push_back(Sound::Sample(data_path("piano/" + s + ".wav")));
+//the piano is synthesized as it plays, so there are no samples to load:
+Load< Sound::Instrument > piano(LoadTagDefault, []() -> Sound::Instrument const * {
+	return new Sound::Instrument();
+});
+
+//MIDI note of key 0 (C4, middle C); the keys go up by semitones from there:
+constexpr uint8_t const piano_first_note = 60;
+
+//room reverb for the piano: there's no recorded impulse response in dist/, so one is made up --
+// noise (different in each ear) that starts after a short pre-delay and dies away by 60dB over 1.8 seconds:
+Load< Sound::Reverb > piano_room(LoadTagDefault, []() -> Sound::Reverb const * {
+	constexpr uint32_t const rate = 48000;
+	uint32_t pre_delay = rate / 100;
+	uint32_t length = uint32_t(1.8f * float(rate));
+	std::mt19937 mt(0x9a40);
+	std::uniform_real_distribution< float > noise(-1.0f, 1.0f);
+	std::vector< float > left(pre_delay + length, 0.0f), right(pre_delay + length, 0.0f);
+	float energy = 0.0f;
+	for (uint32_t i = 0; i < length; ++i) {
+		float decay = std::exp(-6.9f * float(i) / float(length));
+		left[pre_delay + i] = decay * noise(mt);
+		right[pre_delay + i] = decay * noise(mt);
+		energy += left[pre_delay + i] * left[pre_delay + i];
 	}
-	return new std::vector<Sound::Sample>(piano);
+	//scale to unit energy, so the reverb is about as loud as what is sent to it:
+	float scale = 1.0f / std::sqrt(energy);
+	for (auto &f : left) f *= scale;
+	for (auto &f : right) f *= scale;
+	return new Sound::Reverb(left, right);
 });
 
+//how much of each piano note goes to the room reverb:
+constexpr float const piano_reverb_send = 0.3f;
+
 void PlayMode::play_notes(uint32_t code) {
+	//start all the notes together, so the chord doesn't smear:
+	std::vector< uint8_t > notes;
+	std::vector< uint32_t > keys;
 	for (uint32_t i = 0; i < keycount; i++) {
 		if (code & (1 << i)) {
-			piano_keys[i] = Sound::play((*piano_key_samples)[i], 1.0f, 0.0f);
+			notes.emplace_back(uint8_t(piano_first_note + i));
+			keys.emplace_back(i);
 		}
 	}
+	std::vector< std::shared_ptr< Sound::PlayingSample > > playing = Sound::play_notes(*piano, notes);
+	for (uint32_t k = 0; k < keys.size(); k++) {
+		playing[k]->set_reverb_send(piano_reverb_send, 0.0f);
+		piano_keys[keys[k]] = playing[k];
+	}
 }
 
 uint32_t PlayMode::note_count(uint32_t code) {
@@ -159,10 +195,15 @@ PlayMode::PlayMode() : scene(*piano_scene) {
 	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
 	camera = &scene.cameras.front();
 
+	Sound::set_reverb(&*piano_room);
+	Sound::start_analyzer();
+
 	set_answer();
 }
 
 PlayMode::~PlayMode() {
+	Sound::stop_analyzer();
+	Sound::set_reverb(nullptr);
 }
 
 bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
@@ -208,7 +249,8 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 
 				if (!already_pressed) {
 					// play the sound
-					piano_keys[i] = Sound::play((*piano_key_samples)[i], 1.0f, 0.0f);
+					piano_keys[i] = Sound::play_note(*piano, uint8_t(piano_first_note + i));
+					piano_keys[i]->set_reverb_send(piano_reverb_send, 0.0f);
 				}
 				selection ^= 1 << i;
 			}
@@ -230,11 +272,11 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 				evt.motion.xrel / float(window_size.y),
 				-evt.motion.yrel / float(window_size.y)
 			);
-			camera->transform->rotation = glm::normalize(
-				camera->transform->rotation
+			camera->transform->set_rotation(glm::normalize(
+				camera->transform->get_rotation()
 				* glm::angleAxis(-motion.x * camera->fovy, glm::vec3(0.0f, 1.0f, 0.0f))
 				* glm::angleAxis(motion.y * camera->fovy, glm::vec3(1.0f, 0.0f, 0.0f))
-			);
+			));
 			return true;
 		}
 	} */
@@ -267,16 +309,16 @@ void PlayMode::update(float elapsed) {
 		//make it so that moving diagonally doesn't go faster:
 		if (move != glm::vec2(0.0f)) move = glm::normalize(move) * PlayerSpeed * elapsed;
 
-		glm::mat4x3 frame = camera->transform->make_local_to_parent();
+		glm::mat4x3 frame = camera->transform->get_local_to_parent();
 		glm::vec3 frame_right = frame[0];
 		//glm::vec3 up = frame[1];
 		glm::vec3 frame_forward = -frame[2];
 
-		camera->transform->position += move.x * frame_right + move.y * frame_forward;
+		camera->transform->set_position(camera->transform->get_position() + move.x * frame_right + move.y * frame_forward);
 	}
 
 	{ //update listener to camera position:
-		glm::mat4x3 frame = camera->transform->make_local_to_parent();
+		glm::mat4x3 frame = camera->transform->get_local_to_parent();
 		glm::vec3 frame_right = frame[0];
 		glm::vec3 frame_at = frame[3];
 		Sound::listener.set_position_right(frame_at, frame_right, 1.0f / 60.0f);
@@ -342,11 +384,25 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 			glm::vec3(-aspect + 0.1f * H, 0.75f - 0.1f * H, 0.0),
 			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H * 0.9f, 0.0f),
 			glm::u8vec4(0x00, 0x00, 0x00, 0x00));
+
+		//spectrum of the output, as bars in the upper right (-80dB at the bottom to 0dB at the top):
+		Sound::get_spectrum(&spectrum);
+		constexpr float SpectrumWidth = 0.8f;
+		constexpr float SpectrumHeight = 0.3f;
+		glm::vec2 corner = glm::vec2(aspect - 0.05f - SpectrumWidth, 0.95f - SpectrumHeight);
+		for (uint32_t b = 0; b < spectrum.size(); ++b) {
+			float level = std::max(0.0f, std::min(1.0f, (spectrum[b] + 80.0f) / 80.0f));
+			float x = corner.x + SpectrumWidth * (float(b) + 0.5f) / float(spectrum.size());
+			lines.draw(
+				glm::vec3(x, corner.y, 0.0f),
+				glm::vec3(x, corner.y + SpectrumHeight * level, 0.0f),
+				glm::u8vec4(0xff, 0xcc, 0x44, 0x00));
+		}
 	}
 	GL_ERRORS();
 }
 
 /* glm::vec3 PlayMode::get_leg_tip_position() {
 	//the vertex position here was read from the model in blender:
-	return lower_leg->make_local_to_world() * glm::vec4(-1.26137f, -11.861f, 0.0f, 1.0f);
+	return lower_leg->get_local_to_world() * glm::vec4(-1.26137f, -11.861f, 0.0f, 1.0f);
 } */
\ No newline at end of file
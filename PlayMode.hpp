@@ -63,6 +63,9 @@ struct PlayMode : Mode {
 	piano_store piano_keys = std::vector<std::shared_ptr< Sound::PlayingSample >>(keycount);
 	// piano_store piano_guess = std::vector<std::shared_ptr< Sound::PlayingSample >>(keycount);
 	// piano_store piano_answer = std::vector<std::shared_ptr< Sound::PlayingSample >>(keycount);
+
+	//band levels of the output, from Sound::get_spectrum (drawn as bars in the corner):
+	std::vector< float > spectrum;
 	
 	//camera:
 	Scene::Camera *camera = nullptr;
@@ -0,0 +1,110 @@
+#include "RealFFT.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+RealFFT::RealFFT(uint32_t size_, MixKernel const &kernel) : size(size_), fft_pass(kernel.fft_pass) {
+	if (size < 4 || (size & (size - 1)) != 0) {
+		throw std::runtime_error("FFT size " + std::to_string(size) + " is not a power of two (at least 4).");
+	}
+	uint32_t const half_size = size / 2;
+
+	uint32_t bits = 0;
+	while ((1u << bits) < half_size) ++bits;
+	bit_reverse.resize(half_size);
+	for (uint32_t i = 0; i < half_size; ++i) {
+		uint32_t r = 0;
+		for (uint32_t b = 0; b < bits; ++b) {
+			if (i & (1u << b)) r |= 1u << (bits - 1 - b);
+		}
+		bit_reverse[i] = r;
+	}
+
+	//(computed in double precision, so error doesn't build up over the table)
+	double const pi = 3.14159265358979323846;
+	twiddle_re.resize(half_size);
+	twiddle_im.resize(half_size);
+	for (uint32_t half = 1; half < half_size; half *= 2) {
+		for (uint32_t j = 0; j < half; ++j) {
+			double angle = -pi * double(j) / double(half);
+			twiddle_re[half - 1 + j] = float(std::cos(angle));
+			twiddle_im[half - 1 + j] = float(std::sin(angle));
+		}
+	}
+
+	split_re.resize(half_size + 1);
+	split_im.resize(half_size + 1);
+	for (uint32_t k = 0; k <= half_size; ++k) {
+		double angle = -2.0 * pi * double(k) / double(size);
+		split_re[k] = float(std::cos(angle));
+		split_im[k] = float(std::sin(angle));
+	}
+
+	scratch_re.resize(half_size);
+	scratch_im.resize(half_size);
+	permute_re.resize(half_size);
+	permute_im.resize(half_size);
+}
+
+void RealFFT::complex_fft(float *re, float *im) {
+	uint32_t const count = size / 2;
+	for (uint32_t half = 1; half < count; half *= 2) {
+		fft_pass(re, im, count, half, twiddle_re.data() + (half - 1), twiddle_im.data() + (half - 1));
+	}
+}
+
+void RealFFT::forward(float const *in, float *re, float *im) {
+	uint32_t const half_size = size / 2;
+
+	//pack even samples as real parts and odd samples as imaginary parts (in bit-reversed order):
+	for (uint32_t i = 0; i < half_size; ++i) {
+		uint32_t n = bit_reverse[i];
+		scratch_re[i] = in[2 * n];
+		scratch_im[i] = in[2 * n + 1];
+	}
+	complex_fft(scratch_re.data(), scratch_im.data());
+
+	//split into spectra of even (E) and odd (O) samples, then X[k] = E[k] + w^k O[k]:
+	// E[k] = (Z[k] + conj(Z[N/2-k])) / 2, O[k] = (Z[k] - conj(Z[N/2-k])) / 2i
+	for (uint32_t k = 0; k <= half_size; ++k) {
+		uint32_t a = (k == half_size ? 0 : k);
+		uint32_t b = (k == 0 ? 0 : half_size - k);
+		float z_re = scratch_re[a], z_im = scratch_im[a];
+		float c_re = scratch_re[b], c_im = -scratch_im[b];
+		float e_re = 0.5f * (z_re + c_re), e_im = 0.5f * (z_im + c_im);
+		float o_re = 0.5f * (z_im - c_im), o_im = -0.5f * (z_re - c_re);
+		re[k] = e_re + split_re[k] * o_re - split_im[k] * o_im;
+		im[k] = e_im + split_re[k] * o_im + split_im[k] * o_re;
+	}
+}
+
+void RealFFT::inverse(float const *re, float const *im, float *out) {
+	uint32_t const half_size = size / 2;
+	float const scale = 1.0f / float(half_size);
+
+	//join into Z[k] = E[k] + i O[k], where E[k] = (X[k] + conj(X[N/2-k])) / 2, O[k] = w^-k (X[k] - conj(X[N/2-k])) / 2:
+	// (scaled by 2/N here, so the result needs no further scaling)
+	for (uint32_t k = 0; k < half_size; ++k) {
+		uint32_t b = half_size - k;
+		float e_re = 0.5f * (re[k] + re[b]), e_im = 0.5f * (im[k] - im[b]);
+		float d_re = 0.5f * (re[k] - re[b]), d_im = 0.5f * (im[k] + im[b]);
+		float o_re = d_re * split_re[k] + d_im * split_im[k];
+		float o_im = d_im * split_re[k] - d_re * split_im[k];
+		permute_re[k] = scale * (e_re - o_im);
+		permute_im[k] = scale * (e_im + o_re);
+	}
+
+	//inverse complex transform is the forward transform with real and imaginary parts swapped:
+	for (uint32_t i = 0; i < half_size; ++i) {
+		uint32_t n = bit_reverse[i];
+		scratch_re[i] = permute_im[n];
+		scratch_im[i] = permute_re[n];
+	}
+	complex_fft(scratch_re.data(), scratch_im.data());
+
+	for (uint32_t n = 0; n < half_size; ++n) {
+		out[2 * n] = scratch_im[n];
+		out[2 * n + 1] = scratch_re[n];
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+/*
+ * RealFFT transforms blocks of real-valued audio to and from the frequency domain.
+ *
+ * The size is fixed (a power of two) when the RealFFT is made, so all the twiddle
+ *  factors and the bit-reversal order can be computed up front.
+ * Internally, a real transform of size N is done as a complex transform of size N/2
+ *  (the even samples as real parts, the odd samples as imaginary parts),
+ *  whose passes run through the mix kernel's FFTPassFn -- see mix_kernel.hpp.
+ *
+ * Spectra are "split": real and imaginary parts in separate arrays,
+ *  of bins() = N/2 + 1 values (DC through Nyquist).
+ *
+ */
+
+#include "mix_kernel.hpp"
+
+#include <cstdint>
+#include <vector>
+
+struct RealFFT {
+	//'size' must be a power of two, at least 4 (throws otherwise):
+	RealFFT(uint32_t size, MixKernel const &kernel = get_mix_kernel());
+
+	uint32_t size;
+	uint32_t bins() const { return size / 2 + 1; }
+
+	//spectrum of 'size' samples from 'in', to 'bins()' values of 're' and 'im':
+	void forward(float const *in, float *re, float *im);
+
+	//'size' samples from the spectrum in 're' and 'im' (so inverse(forward(x)) == x, up to rounding):
+	void inverse(float const *re, float const *im, float *out);
+
+	//------ internals ------
+	FFTPassFn fft_pass;
+	std::vector< uint32_t > bit_reverse; //(size/2 entries) order of complex transform's inputs
+	std::vector< float > twiddle_re, twiddle_im; //complex transform twiddles, one run of 'half' values for each pass (starting at half - 1)
+	std::vector< float > split_re, split_im; //exp(-2 pi i k / size), for k in [0, size/2] -- to split/join even and odd spectra
+	std::vector< float > scratch_re, scratch_im; //(size/2 entries each) complex transform in progress
+	std::vector< float > permute_re, permute_im; //(size/2 entries each) inverse transform input, before bit-reversal
+
+	//in-place complex transform (of size/2 values, already in bit-reversed order):
+	void complex_fft(float *re, float *im);
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+/*
+ * RingBuffer< T > is a fixed-capacity, single-producer / single-consumer queue.
+ *
+ * Exactly one thread may call push() while exactly one (other) thread calls
+ * pop(); no locks are taken, so neither side can be stalled by the other.
+ * Storage is allocated once, at construction, so neither side ever calls
+ * the allocator afterward.
+ *
+ * This is used to pass commands and data to and from the audio thread.
+ *
+ */
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+template< typename T >
+struct RingBuffer {
+	//capacity is rounded up to a power of two:
+	RingBuffer(uint32_t capacity = 1024) {
+		reset(capacity);
+	}
+
+	//empty the buffer and change its capacity -- only safe while no other thread is using it:
+	void reset(uint32_t capacity) {
+		uint32_t size = 1;
+		while (size < capacity) size *= 2;
+		assert(size <= (1u << 31) && "ring buffer capacity must fit in free-running 32-bit indices");
+		storage.assign(size, T());
+		mask = size - 1;
+		head.store(0, std::memory_order_relaxed);
+		tail.store(0, std::memory_order_relaxed);
+	}
+
+	//producer side -- returns false (and does nothing) if the buffer is full:
+	bool push(T const &value) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask) return false;
+		storage[t & mask] = value;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//consumer side -- returns false (and leaves *value alone) if the buffer is empty:
+	bool pop(T *value) {
+		assert(value);
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		*value = storage[h & mask];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//producer side, in bulk -- pushes as many of 'count' values as fit and returns how many that was:
+	uint32_t push_many(T const *values, uint32_t count) {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t room = (mask + 1) - (t - head.load(std::memory_order_acquire));
+		count = (count < room ? count : room);
+		for (uint32_t i = 0; i < count; ++i) {
+			storage[(t + i) & mask] = values[i];
+		}
+		tail.store(t + count, std::memory_order_release);
+		return count;
+	}
+
+	//consumer side, in bulk -- pops up to 'count' values and returns how many that was:
+	uint32_t pop_many(T *values, uint32_t count) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		uint32_t waiting = tail.load(std::memory_order_acquire) - h;
+		count = (count < waiting ? count : waiting);
+		for (uint32_t i = 0; i < count; ++i) {
+			values[i] = storage[(h + i) & mask];
+		}
+		head.store(h + count, std::memory_order_release);
+		return count;
+	}
+
+	//producer side -- index the next pushed item will have (i.e., total items ever pushed, mod 2^32):
+	uint32_t push_index() const {
+		return tail.load(std::memory_order_relaxed);
+	}
+
+	//consumer side -- drop every item with index before 'index' (a value previously returned by push_index()):
+	void discard_until(uint32_t index) {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (int32_t(index - h) > 0) head.store(index, std::memory_order_release);
+	}
+
+	//number of items waiting (exact from either side; only a snapshot from any other thread):
+	uint32_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+	uint32_t capacity() const {
+		return mask + 1;
+	}
+
+	//internals:
+	std::vector< T > storage;
+	uint32_t mask = 0;
+	std::atomic< uint32_t > head{0}; //index of next item to pop (only written by consumer)
+	std::atomic< uint32_t > tail{0}; //index of next item to push (only written by producer)
+};
@@ -2,73 +2,323 @@
 
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "ThreadPool.hpp"
+#include "transform_kernel.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <fstream>
 
 //-------------------------
 
-glm::mat4x3 Scene::Transform::make_local_to_parent() const {
-	//compute:
-	//   translate   *   rotate    *   scale
-	// [ 1 0 0 p.x ]   [       0 ]   [ s.x 0 0 0 ]
-	// [ 0 1 0 p.y ] * [ rot   0 ] * [ 0 s.y 0 0 ]
-	// [ 0 0 1 p.z ]   [       0 ]   [ 0 0 s.z 0 ]
-	//                 [ 0 0 0 1 ]   [ 0 0   0 1 ]
-
-	glm::mat3 rot = glm::mat3_cast(rotation);
-	return glm::mat4x3(
-		rot[0] * scale.x, //scaling the columns here means that scale happens before rotation
-		rot[1] * scale.y,
-		rot[2] * scale.z,
-		position
-	);
+//the store's layout matches what transform_kernel expects:
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float) && sizeof(glm::mat4x3) == 12 * sizeof(float), "glm vectors and matrices are tightly packed");
+static_assert(sizeof(glm::quat) == 4 * sizeof(float) && offsetof(glm::quat, x) == 0 && offsetof(glm::quat, w) == 3 * sizeof(float), "quaternions are stored x,y,z,w");
+
+//local_to_parent and parent_to_local for a single transform (computed as update() would):
+static void make_local_matrices(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale, glm::mat4x3 *local_to_parent, glm::mat4x3 *parent_to_local) {
+	uint32_t const index = 0;
+	get_transform_kernel().local_matrices(&index, 1,
+		&position.x, &rotation.x, &scale.x,
+		&(*local_to_parent)[0].x, &(*parent_to_local)[0].x);
 }
 
-glm::mat4x3 Scene::Transform::make_parent_to_local() const {
-	//compute:
-	//   1/scale       *    rot^-1   *  translate^-1
-	// [ 1/s.x 0 0 0 ]   [       0 ]   [ 0 0 0 -p.x ]
-	// [ 0 1/s.y 0 0 ] * [rot^-1 0 ] * [ 0 0 0 -p.y ]
-	// [ 0 0 1/s.z 0 ]   [       0 ]   [ 0 0 0 -p.z ]
-	//                   [ 0 0 0 1 ]   [ 0 0 0  1   ]
-
-	glm::vec3 inv_scale;
-	//taking some care so that we don't end up with NaN's , just a degenerate matrix, if scale is zero:
-	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
-	inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
-	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
-
-	//compute inverse of rotation:
-	glm::mat3 inv_rot = glm::mat3_cast(glm::inverse(rotation));
-
-	//scale the rows of rot:
-	inv_rot[0] *= inv_scale;
-	inv_rot[1] *= inv_scale;
-	inv_rot[2] *= inv_scale;
-
-	return glm::mat4x3(
-		inv_rot[0],
-		inv_rot[1],
-		inv_rot[2],
-		inv_rot * -position
-	);
-}
-
-glm::mat4x3 Scene::Transform::make_local_to_world() const {
-	if (!parent) {
-		return make_local_to_parent();
-	} else {
-		return parent->make_local_to_world() * glm::mat4(make_local_to_parent()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+//-------------------------
+
+uint32_t Scene::TransformStore::add(Transform *handle_) {
+	assert(handle_);
+	uint32_t index = size();
+	position.emplace_back(0.0f);
+	rotation.emplace_back(1.0f, 0.0f, 0.0f, 0.0f); //n.b. wxyz init order
+	scale.emplace_back(1.0f);
+	parent.emplace_back(-1U);
+	local_to_parent.emplace_back(1.0f);
+	parent_to_local.emplace_back(1.0f);
+	local_to_world.emplace_back(1.0f);
+	world_to_local.emplace_back(1.0f);
+	dirty.emplace_back(uint8_t(0)); //(matrices above already match the identity transform)
+	handle.emplace_back(handle_);
+	levels_valid = false;
+	return index;
+}
+
+void Scene::TransformStore::remove(uint32_t index) {
+	assert(index < size() && handle[index]);
+	//slot is dropped (and any children are detached) during the next sort():
+	handle[index] = nullptr;
+	parent[index] = -1U;
+	sorted = false;
+	up_to_date = false;
+	levels_valid = false;
+}
+
+void Scene::TransformStore::set_parent(uint32_t index, uint32_t parent_) {
+	assert(index < size() && handle[index]);
+	if (parent[index] == parent_) return;
+	if (parent_ != -1U) {
+		assert(parent_ < size() && handle[parent_]);
+		//a transform can't be its own ancestor:
+		for (uint32_t a = parent_; a != -1U; a = parent[a]) {
+			if (a == index) throw std::runtime_error("Transform '" + handle[index]->name + "' can't be parented to its own descendant '" + handle[parent_]->name + "'.");
+		}
+		if (parent_ > index) sorted = false;
+	}
+	parent[index] = parent_;
+	dirty[index] = 1;
+	up_to_date = false;
+	levels_valid = false;
+}
+
+void Scene::TransformStore::sort() {
+	if (sorted) return;
+
+	//new order visits transforms in current order, but places any not-yet-placed ancestors first:
+	// (so a store that is already in order apart from freed slots just gets compacted)
+	std::vector< uint32_t > order;
+	order.reserve(size());
+	std::vector< uint32_t > new_index(size(), -1U);
+	std::vector< uint32_t > chain;
+	for (uint32_t i = 0; i < size(); ++i) {
+		if (!handle[i] || new_index[i] != -1U) continue;
+		//collect the unplaced part of the ancestor chain:
+		for (uint32_t a = i; a != -1U && new_index[a] == -1U; a = parent[a]) {
+			if (!handle[a]) break; //(removed ancestor; the transform below it becomes a root)
+			chain.emplace_back(a);
+		}
+		//..and place it root-first:
+		while (!chain.empty()) {
+			new_index[chain.back()] = uint32_t(order.size());
+			order.emplace_back(chain.back());
+			chain.pop_back();
+		}
+	}
+
+	//permute every array into the new order:
+	auto permute = [&order](auto &array) {
+		std::remove_reference_t< decltype(array) > sorted_array;
+		sorted_array.reserve(order.size());
+		for (uint32_t i : order) sorted_array.emplace_back(array[i]);
+		array = std::move(sorted_array);
+	};
+	permute(position);
+	permute(rotation);
+	permute(scale);
+	permute(parent);
+	permute(local_to_parent);
+	permute(parent_to_local);
+	permute(local_to_world);
+	permute(world_to_local);
+	permute(dirty);
+	permute(handle);
+
+	for (uint32_t i = 0; i < size(); ++i) {
+		handle[i]->index = i;
+		if (parent[i] == -1U) continue;
+		if (new_index[parent[i]] == -1U) {
+			//parent was removed:
+			parent[i] = -1U;
+			dirty[i] = 1;
+		} else {
+			parent[i] = new_index[parent[i]];
+			assert(parent[i] < i);
+		}
+	}
+
+	sorted = true;
+	levels_valid = false;
+}
+
+void Scene::TransformStore::update_slots(uint32_t const *slots, uint32_t count) {
+	assert(count <= Batch);
+	if (count == 0) return;
+
+	//find the transforms that changed (a transform changes if it is dirty or its parent changed):
+	uint32_t dirty_slots[Batch];
+	uint32_t dirty_count = 0;
+	uint32_t changed_slots[Batch];
+	uint32_t changed_count = 0;
+	for (uint32_t k = 0; k < count; ++k) {
+		uint32_t i = slots[k];
+		uint32_t p = parent[i];
+		changed[i] = uint8_t(dirty[i] || (p != -1U && changed[p]));
+		if (dirty[i]) {
+			dirty_slots[dirty_count++] = i;
+			dirty[i] = 0;
+		}
+		if (changed[i]) changed_slots[changed_count++] = i;
+	}
+
+	//..and recompute their matrices in batches:
+	TransformKernel const &kernel = get_transform_kernel();
+	if (dirty_count) {
+		kernel.local_matrices(dirty_slots, dirty_count,
+			&position[0].x, &rotation[0].x, &scale[0].x,
+			&local_to_parent[0][0].x, &parent_to_local[0][0].x);
+	}
+	if (changed_count) {
+		kernel.compose(changed_slots, changed_count, parent.data(),
+			&local_to_parent[0][0].x, &parent_to_local[0][0].x,
+			&local_to_world[0][0].x, &world_to_local[0][0].x);
 	}
 }
-glm::mat4x3 Scene::Transform::make_world_to_local() const {
-	if (!parent) {
-		return make_parent_to_local();
-	} else {
-		return make_parent_to_local() * glm::mat4(parent->make_world_to_local()); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+
+void Scene::TransformStore::update() {
+	sort();
+	if (up_to_date) return;
+
+	//since parents come before children, one front-to-back pass sees every parent's matrices before its children need them:
+	changed.resize(size());
+	uint32_t slots[Batch];
+	for (uint32_t begin = 0; begin < size(); begin += Batch) {
+		uint32_t count = std::min(Batch, size() - begin);
+		for (uint32_t k = 0; k < count; ++k) {
+			slots[k] = begin + k;
+		}
+		update_slots(slots, count);
+	}
+
+	up_to_date = true;
+}
+
+void Scene::TransformStore::update_parallel(ThreadPool &pool) {
+	sort();
+	if (up_to_date) return;
+
+	build_levels();
+	changed.resize(size());
+
+	//transforms within a level don't depend on each other, so each level is split into batches for the pool:
+	// (the matrix kernels give the same results however transforms are batched, so the results don't depend on the number of threads)
+	// (levels of one batch or less aren't worth waking the pool for)
+	for (uint32_t level = 0; level + 1 < level_begin.size(); ++level) {
+		uint32_t begin = level_begin[level];
+		uint32_t end = level_begin[level + 1];
+		if (end - begin <= Batch) {
+			update_slots(level_order.data() + begin, end - begin);
+		} else {
+			pool.parallel_for((end - begin + Batch - 1) / Batch, [&](uint32_t item) {
+				uint32_t batch_begin = begin + item * Batch;
+				update_slots(level_order.data() + batch_begin, std::min(Batch, end - batch_begin));
+			});
+		}
+	}
+
+	up_to_date = true;
+}
+
+void Scene::TransformStore::build_levels() {
+	assert(sorted);
+	if (levels_valid) return;
+
+	//depth of every transform (parents come first, so theirs is already known):
+	std::vector< uint32_t > depth(size());
+	uint32_t levels = 0;
+	for (uint32_t i = 0; i < size(); ++i) {
+		depth[i] = (parent[i] == -1U ? 0 : depth[parent[i]] + 1);
+		levels = std::max(levels, depth[i] + 1);
+	}
+
+	//counting sort by depth:
+	level_begin.assign(levels + 1, 0);
+	for (uint32_t i = 0; i < size(); ++i) {
+		level_begin[depth[i] + 1] += 1;
+	}
+	for (uint32_t d = 0; d < levels; ++d) {
+		level_begin[d + 1] += level_begin[d];
 	}
+	level_order.resize(size());
+	std::vector< uint32_t > next(level_begin.begin(), level_begin.end() - 1);
+	for (uint32_t i = 0; i < size(); ++i) {
+		level_order[next[depth[i]]++] = i;
+	}
+
+	levels_valid = true;
+}
+
+//-------------------------
+
+Scene::Transform::Transform(TransformStore *store_) : store(store_), index(store_->add(this)) {
+}
+
+Scene::Transform::~Transform() {
+	store->remove(index);
+}
+
+glm::vec3 const &Scene::Transform::get_position() const {
+	return store->position[index];
+}
+
+glm::quat const &Scene::Transform::get_rotation() const {
+	return store->rotation[index];
+}
+
+glm::vec3 const &Scene::Transform::get_scale() const {
+	return store->scale[index];
+}
+
+void Scene::Transform::set_position(glm::vec3 const &position_) {
+	store->position[index] = position_;
+	store->dirty[index] = 1;
+	store->up_to_date = false;
+}
+
+void Scene::Transform::set_rotation(glm::quat const &rotation_) {
+	store->rotation[index] = rotation_;
+	store->dirty[index] = 1;
+	store->up_to_date = false;
+}
+
+void Scene::Transform::set_scale(glm::vec3 const &scale_) {
+	store->scale[index] = scale_;
+	store->dirty[index] = 1;
+	store->up_to_date = false;
+}
+
+Scene::Transform *Scene::Transform::get_parent() const {
+	uint32_t p = store->parent[index];
+	return (p == -1U ? nullptr : store->handle[p]); //(handle is nullptr for a removed parent)
+}
+
+void Scene::Transform::set_parent(Transform *parent_) {
+	assert(!parent_ || parent_->store == store); //transforms must be in the same scene
+	store->set_parent(index, parent_ ? parent_->index : -1U);
+}
+
+glm::mat4x3 Scene::Transform::make_local_to_parent() const {
+	glm::mat4x3 local_to_parent, parent_to_local;
+	make_local_matrices(get_position(), get_rotation(), get_scale(), &local_to_parent, &parent_to_local);
+	return local_to_parent;
+}
+
+glm::mat4x3 Scene::Transform::make_parent_to_local() const {
+	glm::mat4x3 local_to_parent, parent_to_local;
+	make_local_matrices(get_position(), get_rotation(), get_scale(), &local_to_parent, &parent_to_local);
+	return parent_to_local;
+}
+
+glm::mat4x3 const &Scene::Transform::get_local_to_parent() const {
+	if (!store->up_to_date) store->update();
+	return store->local_to_parent[index];
+}
+
+glm::mat4x3 const &Scene::Transform::get_local_to_world() const {
+	if (!store->up_to_date) store->update();
+	return store->local_to_world[index];
+}
+
+glm::mat4x3 const &Scene::Transform::get_world_to_local() const {
+	if (!store->up_to_date) store->update();
+	return store->world_to_local[index];
+}
+
+//-------------------------
+
+Scene::Transform *Scene::add_transform() {
+	transforms.emplace_back(&transform_store);
+	return &transforms.back();
 }
 
 //-------------------------
@@ -79,17 +329,55 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //-------------------------
 
+//put the order that sorts 'keys' (stable, so equal keys keep their order) in 'order', using 'sorted' as scratch space:
+// (LSD radix sort, a byte at a time; bytes that are the same in every key are skipped)
+static void radix_sort_order(std::vector< uint64_t > const &keys, std::vector< uint32_t > *order_, std::vector< uint32_t > *sorted_) {
+	assert(order_ && sorted_);
+	std::vector< uint32_t > &order = *order_;
+	std::vector< uint32_t > &sorted = *sorted_;
+	uint32_t count = uint32_t(keys.size());
+
+	//histograms of every byte, counted in a single pass:
+	uint32_t histograms[8][256] = {};
+	for (uint64_t key : keys) {
+		for (uint32_t b = 0; b < 8; ++b) {
+			histograms[b][(key >> (8 * b)) & 0xff] += 1;
+		}
+	}
+
+	order.resize(count);
+	for (uint32_t i = 0; i < count; ++i) order[i] = i;
+	sorted.resize(count);
+	for (uint32_t b = 0; b < 8; ++b) {
+		uint32_t *histogram = histograms[b];
+		if (count == 0 || histogram[(keys[0] >> (8 * b)) & 0xff] == count) continue; //every key has the same byte here
+		//histogram -> first position of each byte value:
+		uint32_t position = 0;
+		for (uint32_t v = 0; v < 256; ++v) {
+			uint32_t n = histogram[v];
+			histogram[v] = position;
+			position += n;
+		}
+		for (uint32_t i : order) {
+			sorted[histogram[(keys[i] >> (8 * b)) & 0xff]++] = i;
+		}
+		std::swap(order, sorted); //(swaps the buffers; nothing is copied)
+	}
+}
 
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
-	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->get_world_to_local());
 	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
 	draw(world_to_clip, world_to_light);
 }
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	//Gather the drawables that will actually draw something:
+	std::vector< Drawable const * > &to_draw = draw_scratch.to_draw;
+	to_draw.clear();
+	to_draw.reserve(drawables.size());
 	for (auto const &drawable : drawables) {
 		//Reference to drawable's pipeline for convenience:
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
@@ -101,63 +389,129 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//skip any drawables that don't contain any vertices:
 		if (pipeline.count == 0) continue;
 
+		to_draw.emplace_back(&drawable);
+	}
+
+	//Compute the matrices used by their uniforms, all at once:
+	std::vector< glm::mat4x3 > &object_to_world = draw_scratch.object_to_world;
+	object_to_world.clear();
+	for (Drawable const *drawable : to_draw) {
+		assert(drawable->transform); //drawables *must* have a transform
+		object_to_world.emplace_back(drawable->transform->get_local_to_world());
+	}
+	//(every element is written by draw_matrices, so the old contents don't matter)
+	std::vector< glm::mat4 > &object_to_clip = draw_scratch.object_to_clip;
+	std::vector< glm::mat4x3 > &object_to_light = draw_scratch.object_to_light;
+	std::vector< glm::mat3 > &normal_to_light = draw_scratch.normal_to_light;
+	object_to_clip.resize(to_draw.size());
+	object_to_light.resize(to_draw.size());
+	normal_to_light.resize(to_draw.size());
+	if (!to_draw.empty()) {
+		get_transform_kernel().draw_matrices(glm::value_ptr(world_to_clip), glm::value_ptr(world_to_light),
+			glm::value_ptr(object_to_world[0]), uint32_t(to_draw.size()),
+			glm::value_ptr(object_to_clip[0]), glm::value_ptr(object_to_light[0]), glm::value_ptr(normal_to_light[0]));
+	}
+
+	//Sort drawables so that ones sharing GL state are drawn together:
+	std::vector< uint64_t > &keys = draw_scratch.keys;
+	keys.clear();
+	{
+		//state is numbered densely, in order of first use, so that it fits in a 64-bit key:
+		// program (16 bits) | vao (20 bits) | textures (20 bits) | primitive type (8 bits)
+		// (numbers past the end of their field share the last value; that just makes for a less-sorted queue, since state changes are still checked below)
+		draw_scratch.programs.clear(uint32_t(to_draw.size()));
+		draw_scratch.vaos.clear(uint32_t(to_draw.size()));
+		draw_scratch.texture_sets.clear(uint32_t(to_draw.size()));
+		auto number = [](auto &numbering, auto const &state, uint64_t max) {
+			return std::min< uint64_t >(numbering.number(state), max);
+		};
+		for (Drawable const *drawable : to_draw) {
+			Scene::Drawable::Pipeline const &pipeline = drawable->pipeline;
+			std::array< GLuint, 2 * Drawable::Pipeline::TextureCount > textures;
+			for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+				textures[2*i+0] = pipeline.textures[i].texture;
+				textures[2*i+1] = (pipeline.textures[i].texture != 0 ? pipeline.textures[i].target : 0);
+			}
+			keys.emplace_back(
+				  (number(draw_scratch.programs, pipeline.program, 0xffff) << 48)
+				| (number(draw_scratch.vaos, pipeline.vao, 0xfffff) << 28)
+				| (number(draw_scratch.texture_sets, textures, 0xfffff) << 8)
+				| uint64_t(pipeline.type & 0xff)
+			);
+		}
+	}
+	std::vector< uint32_t > &order = draw_scratch.order;
+	radix_sort_order(keys, &order, &draw_scratch.sorted);
+
+	//GL state set so far (to skip redundant changes):
+	GLuint bound_program = 0;
+	GLuint bound_vao = 0;
+	Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount];
+
+	//Send each drawable to OpenGL:
+	for (uint32_t d : order) {
+		Scene::Drawable::Pipeline const &pipeline = to_draw[d]->pipeline;
 
 		//Set shader program:
-		glUseProgram(pipeline.program);
+		if (pipeline.program != bound_program) {
+			glUseProgram(pipeline.program);
+			bound_program = pipeline.program;
+		}
 
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		if (pipeline.vao != bound_vao) {
+			glBindVertexArray(pipeline.vao);
+			bound_vao = pipeline.vao;
+		}
 
 		//Configure program uniforms:
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
-
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip[d]));
 		}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
-
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
+		//OBJECT_TO_LIGHT takes vertices from object space to light space:
 		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light[d]));
 		}
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
+		//NORMAL_TO_LIGHT takes normals from object space to light space:
 		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light[d]));
 		}
 
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
-		//set up textures:
+		//set up textures (units this drawable doesn't use are left empty, as they would be if textures were unbound after each draw):
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[i];
+			Drawable::Pipeline::TextureInfo &bound = bound_textures[i];
+			if (want.texture == bound.texture && (want.texture == 0 || want.target == bound.target)) continue;
+			glActiveTexture(GL_TEXTURE0 + i);
+			if (bound.texture != 0 && (want.texture == 0 || want.target != bound.target)) {
+				glBindTexture(bound.target, 0);
 			}
+			if (want.texture != 0) {
+				glBindTexture(want.target, want.texture);
+			}
+			bound.texture = want.texture;
+			bound.target = want.target;
 		}
 
 		//draw the object:
 		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+	}
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (bound_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(bound_textures[i].target, 0);
 		}
-		glActiveTexture(GL_TEXTURE0);
-
 	}
+	glActiveTexture(GL_TEXTURE0);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -225,13 +579,12 @@ void Scene::load(std::string const &filename,
 	hierarchy_transforms.reserve(hierarchy.size());
 
 	for (auto const &h : hierarchy) {
-		transforms.emplace_back();
-		Transform *t = &transforms.back();
+		Transform *t = add_transform();
 		if (h.parent != -1U) {
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
 			}
-			t->parent = hierarchy_transforms[h.parent];
+			t->set_parent(hierarchy_transforms[h.parent]);
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
@@ -240,9 +593,9 @@ void Scene::load(std::string const &filename,
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
 
-		t->position = h.position;
-		t->rotation = h.rotation;
-		t->scale = h.scale;
+		t->set_position(h.position);
+		t->set_rotation(h.rotation);
+		t->set_scale(h.scale);
 
 		hierarchy_transforms.emplace_back(t);
 	}
@@ -340,21 +693,21 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 	//Copy transforms and store mapping:
 	transforms.clear();
 	for (auto const &t : other.transforms) {
-		transforms.emplace_back();
-		transforms.back().name = t.name;
-		transforms.back().position = t.position;
-		transforms.back().rotation = t.rotation;
-		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
+		Transform *copy = add_transform();
+		copy->name = t.name;
+		copy->set_position(t.get_position());
+		copy->set_rotation(t.get_rotation());
+		copy->set_scale(t.get_scale());
+		//(parent is set below, once every transform has been copied)
 
 		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
+		auto ret = transform_to_transform.insert(std::make_pair(&t, copy));
 		assert(ret.second);
 	}
 
-	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	//set transform parents:
+	for (auto const &t : other.transforms) {
+		transform_to_transform.at(&t)->set_parent(transform_to_transform.at(t.get_parent()));
 	}
 
 	//copy other's drawables, updating transform pointers:
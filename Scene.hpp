@@ -15,6 +15,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <array>
 #include <list>
 #include <memory>
 #include <functional>
@@ -22,31 +23,100 @@
 #include <vector>
 #include <unordered_map>
 
+struct ThreadPool;
+
 struct Scene {
+	struct TransformStore;
+
+	//a 'Transform' is a handle to one transformation in the scene's TransformStore (below):
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
 		std::string name;
 
 		//The core function of a transform is to store a transformation in the world:
-		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
-		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //n.b. wxyz init order
-		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+		// (change it with the set_* functions, so that the cached matrices below know to update)
+		// (references returned by get_* functions are valid until the next transform is added to the scene)
+		glm::vec3 const &get_position() const;
+		glm::quat const &get_rotation() const;
+		glm::vec3 const &get_scale() const;
+		void set_position(glm::vec3 const &position_);
+		void set_rotation(glm::quat const &rotation_);
+		void set_scale(glm::vec3 const &scale_);
 
-		//The transform above may be relative to some parent transform:
-		Transform *parent = nullptr;
+		//The transform above may be relative to some parent transform (in the same scene):
+		Transform *get_parent() const;
+		void set_parent(Transform *parent_);
 
 		//It is often convenient to construct matrices representing this transformation:
 		// ..relative to its parent:
 		glm::mat4x3 make_local_to_parent() const;
 		glm::mat4x3 make_parent_to_local() const;
-		// ..relative to the world:
-		glm::mat4x3 make_local_to_world() const;
-		glm::mat4x3 make_world_to_local() const;
+		// ..the same, but cached:
+		glm::mat4x3 const &get_local_to_parent() const;
+		// ..relative to the world (cached; after any change, the store is updated -- see TransformStore::update -- on the next call):
+		glm::mat4x3 const &get_local_to_world() const;
+		glm::mat4x3 const &get_world_to_local() const;
 
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
-		//if we delete some constructors, we need to let the compiler know that the default constructor is still okay:
-		Transform() = default;
+		//transforms are made by Scene::add_transform, which supplies the store:
+		Transform(TransformStore *store);
+		//(frees its slot in the store; any children are left without a parent)
+		~Transform();
+
+		//internals:
+		TransformStore *store;
+		uint32_t index; //slot in store (changes when the store is re-sorted)
+	};
+
+	//The 'TransformStore' holds the data for every transform in the scene in parallel arrays,
+	// sorted so that each transform comes after its parent (as in the 'xfh0' chunk of a scene file).
+	// This lets update() bring the whole hierarchy up to date in one front-to-back pass over contiguous memory:
+	struct TransformStore {
+		//per-transform data, indexed by Transform::index:
+		std::vector< glm::vec3 > position;
+		std::vector< glm::quat > rotation;
+		std::vector< glm::vec3 > scale;
+		std::vector< uint32_t > parent; //index of parent (-1U for none); always less than the transform's own index once sorted
+		//matrices (up to date after update()):
+		std::vector< glm::mat4x3 > local_to_parent;
+		std::vector< glm::mat4x3 > parent_to_local;
+		std::vector< glm::mat4x3 > local_to_world;
+		std::vector< glm::mat4x3 > world_to_local;
+		std::vector< uint8_t > dirty; //data changed since the last update()?
+		std::vector< Transform * > handle; //handle for each slot (nullptr for slots freed since the last sort)
+
+		uint32_t size() const { return uint32_t(handle.size()); }
+
+		//add a slot (at the origin, without parent) for 'handle_'; returns its index:
+		uint32_t add(Transform *handle_);
+		//free a slot (its children become roots):
+		void remove(uint32_t index);
+		//change a slot's parent (-1U for none):
+		void set_parent(uint32_t index, uint32_t parent_);
+
+		//bring every matrix up to date -- only the matrices of transforms that changed, and their descendants, are recomputed:
+		void update();
+		bool up_to_date = true; //(cleared by any change)
+
+		//the same, but spread over the threads of 'pool' (e.g., ThreadPool::get_shared()); results are identical to update():
+		// (worthwhile for scenes with many thousands of transforms; call before drawing, since the get_* functions use update())
+		void update_parallel(ThreadPool &pool);
+
+		//restore parent-before-child order (and drop freed slots), updating handles' indices:
+		void sort();
+		bool sorted = true; //(cleared by a remove(), or a set_parent() that puts a parent after its child)
+
+		std::vector< uint8_t > changed; //(scratch for update) transform or an ancestor was dirty
+		//(update a batch of slots, in order; parents must be earlier in the batch or already done)
+		static constexpr uint32_t Batch = 512;
+		void update_slots(uint32_t const *slots, uint32_t count);
+
+		//transforms grouped by depth in the hierarchy (each level only depends on earlier ones), for update_parallel:
+		std::vector< uint32_t > level_order; //slots sorted by depth (and then by index)
+		std::vector< uint32_t > level_begin; //level 'd' is level_order[level_begin[d], level_begin[d+1])
+		bool levels_valid = false; //(cleared when the hierarchy changes)
+		void build_levels();
 	};
 
 	struct Drawable {
@@ -120,17 +190,73 @@ struct Scene {
 	};
 
 	//Scenes, of course, may have many of the above objects:
+	TransformStore transform_store; //(declared before 'transforms', so it outlives their handles)
 	std::list< Transform > transforms;
 	std::list< Drawable > drawables;
 	std::list< Camera > cameras;
 	std::list< Light > lights;
 
+	//add a transform (at the origin, without parent) to the scene:
+	Transform *add_transform();
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
+	// (drawables are sorted by program, vertex array, textures, and primitive type -- otherwise keeping their order -- so GL state only changes when it must)
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//scratch space for draw() -- kept between calls, so drawing doesn't allocate once the scene has been drawn:
+	// (not copied along with the scene)
+	struct DrawScratch {
+		std::vector< Drawable const * > to_draw; //drawables that will actually draw something
+		//...and their matrices:
+		std::vector< glm::mat4x3 > object_to_world;
+		std::vector< glm::mat4 > object_to_clip;
+		std::vector< glm::mat4x3 > object_to_light;
+		std::vector< glm::mat3 > normal_to_light;
+		//...and the order to draw them in:
+		std::vector< uint64_t > keys; //GL state of each drawable, packed so that sorting groups shared state
+		std::vector< uint32_t > order, sorted; //(sorted is the radix sort's second buffer)
+
+		//numbers distinct values densely, in order of first use (to fit GL state into 'keys'):
+		// (an open-addressing hash table, so clearing it each frame doesn't free anything)
+		template< typename T >
+		struct Numbering {
+			std::vector< T > values; //values[n] is the value numbered 'n'
+			std::vector< uint32_t > slots; //1 + the number of the value in each slot (0 if empty); size is a power of two
+
+			//forget all values, making room for up to 'count' new ones:
+			void clear(uint32_t count) {
+				values.clear();
+				uint32_t size = 16;
+				while (size < 2 * count) size *= 2;
+				slots.assign(size, 0);
+			}
+			//the number of 'value' (numbering it, if it is new):
+			uint32_t number(T const &value) {
+				static_assert(sizeof(T) % sizeof(GLuint) == 0, "values are hashed a GLuint at a time");
+				GLuint const *words = reinterpret_cast< GLuint const * >(&value);
+				uint32_t hash = 2166136261u; //(FNV-1a, a word at a time)
+				for (uint32_t i = 0; i < sizeof(T) / sizeof(GLuint); ++i) {
+					hash = (hash ^ words[i]) * 16777619u;
+				}
+				hash ^= hash >> 16;
+				uint32_t const mask = uint32_t(slots.size()) - 1;
+				for (uint32_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+					if (slots[slot] == 0) {
+						values.emplace_back(value);
+						slots[slot] = uint32_t(values.size());
+					}
+					if (values[slots[slot] - 1] == value) return slots[slot] - 1;
+				}
+			}
+		};
+		Numbering< GLuint > programs, vaos;
+		Numbering< std::array< GLuint, 2 * Drawable::Pipeline::TextureCount > > texture_sets; //(texture, target) for each unit
+	};
+	mutable DrawScratch draw_scratch;
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
@@ -10,16 +10,14 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 
 	//Set up scene:
 	{ //create a single camera:
-		scene.transforms.emplace_back();
-		scene.cameras.emplace_back(&scene.transforms.back());
+		scene.cameras.emplace_back(scene.add_transform());
 		scene_camera = &scene.cameras.back();
 		scene_camera->fovy = 60.0f / 180.0f * 3.1415926f;
 		scene_camera->near = 0.01f;
 		//scene_camera->transform and scene_camera->aspect will be set in draw()
 	}
 	{ //create a drawable to hold the current mesh:
-		scene.transforms.emplace_back();
-		scene.drawables.emplace_back(&scene.transforms.back());
+		scene.drawables.emplace_back(scene.add_transform());
 		scene_drawable = &scene.drawables.back();
 
 		scene_drawable->pipeline = show_meshes_program_pipeline;
@@ -69,7 +67,7 @@ bool ShowMeshesMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window
 			if (SDL_GetModState() & KMOD_SHIFT) {
 				//shift: pan
 
-				glm::mat3 frame = glm::mat3_cast(scene_camera->transform->rotation);
+				glm::mat3 frame = glm::mat3_cast(scene_camera->transform->get_rotation());
 				camera.target -= frame[0] * (delta.x * camera.radius) + frame[1] * (delta.y * camera.radius);
 			} else {
 				//no shift: tumble
@@ -104,12 +102,12 @@ bool ShowMeshesMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window
 void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 	//--- use camera structure to set up scene camera ---
 
-	scene_camera->transform->rotation =
+	scene_camera->transform->set_rotation(
 		glm::angleAxis(camera.azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
 		* glm::angleAxis(0.5f * 3.1415926f + -camera.elevation, glm::vec3(1.0f, 0.0f, 0.0f))
-	;
-	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
-	scene_camera->transform->scale = glm::vec3(1.0f);
+	);
+	scene_camera->transform->set_position(camera.target + camera.radius * (scene_camera->transform->get_rotation() * glm::vec3(0.0f, 0.0f, 1.0f)));
+	scene_camera->transform->set_scale(glm::vec3(1.0f));
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -123,7 +121,7 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 	scene.draw(*scene_camera);
 
 	{ //decorate with some lines:
-		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
+		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->get_world_to_local()));
 
 		//axis (unit-length):
 		draw_lines.draw(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::u8vec4(0xff, 0x00, 0x00, 0xff));
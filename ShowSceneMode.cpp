@@ -7,8 +7,7 @@ ShowSceneMode::ShowSceneMode(Scene const &scene_) : scene(scene_) {
 
 	//Set up camera-only scene:
 	{ //create a single camera:
-		camera_scene.transforms.emplace_back();
-		camera_scene.cameras.emplace_back(&camera_scene.transforms.back());
+		camera_scene.cameras.emplace_back(camera_scene.add_transform());
 		scene_camera = &camera_scene.cameras.back();
 		scene_camera->fovy = 60.0f / 180.0f * 3.1415926f;
 		scene_camera->near = 0.01f;
@@ -40,7 +39,7 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 			if (SDL_GetModState() & KMOD_SHIFT) {
 				//shift: pan
 
-				glm::mat3 frame = glm::mat3_cast(scene_camera->transform->rotation);
+				glm::mat3 frame = glm::mat3_cast(scene_camera->transform->get_rotation());
 				camera.target -= frame[0] * (delta.x * camera.radius) + frame[1] * (delta.y * camera.radius);
 			} else {
 				//no shift: tumble
@@ -75,12 +74,12 @@ bool ShowSceneMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_
 void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	//--- use camera structure to set up scene camera ---
 
-	scene_camera->transform->rotation =
+	scene_camera->transform->set_rotation(
 		glm::angleAxis(camera.azimuth, glm::vec3(0.0f, 0.0f, 1.0f))
 		* glm::angleAxis(0.5f * 3.1415926f + -camera.elevation, glm::vec3(1.0f, 0.0f, 0.0f))
-	;
-	scene_camera->transform->position = camera.target + camera.radius * (scene_camera->transform->rotation * glm::vec3(0.0f, 0.0f, 1.0f));
-	scene_camera->transform->scale = glm::vec3(1.0f);
+	);
+	scene_camera->transform->set_position(camera.target + camera.radius * (scene_camera->transform->get_rotation() * glm::vec3(0.0f, 0.0f, 1.0f)));
+	scene_camera->transform->set_scale(glm::vec3(1.0f));
 	scene_camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
 
@@ -94,9 +93,9 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 	scene.draw(*scene_camera);
 
 	{ //decorate with some lines:
-		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->make_world_to_local()));
+		DrawLines draw_lines(scene_camera->make_projection() * glm::mat4(scene_camera->transform->get_world_to_local()));
 		for (auto &transform : scene.transforms) {
-			glm::mat4 local_to_world = transform.make_local_to_world();
+			glm::mat4 local_to_world = transform.get_local_to_world();
 			auto xf = [&local_to_world](glm::vec3 const &vec) {
 				return glm::vec3(local_to_world * glm::vec4(vec, 1.0f));
 			};
@@ -104,9 +103,9 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 				return glm::vec3(local_to_world * glm::vec4(vec, 0.0f));
 			};
 
-			if (transform.parent) {
+			if (transform.get_parent()) {
 				//connect to parent:
-				glm::vec3 p = glm::vec3(transform.parent->make_local_to_world()[3]);
+				glm::vec3 p = transform.get_parent()->get_local_to_world()[3];
 				draw_lines.draw(p, xf(glm::vec3(0.0f)), glm::u8vec4(0xff, 0xff, 0x00, 0xff));
 			}
 
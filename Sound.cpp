@@ -1,27 +1,331 @@
 #include "Sound.hpp"
+#include "adpcm.hpp"
+#include "ConvolutionReverb.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "mix_kernel.hpp"
+#include "ModalSynth.hpp"
+#include "OpusStream.hpp"
+#include "pcm_cache.hpp"
+#include "RingBuffer.hpp"
+#include "SpectrumAnalyzer.hpp"
+#include "ThreadPool.hpp"
 
 #include <SDL.h>
 
-#include <list>
 #include <cassert>
 #include <exception>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
 
 //local (to this file) data used by the audio system:
 namespace {
 
 	//handy constants:
 	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const MIN_MIX_SAMPLES = 128; //range of block sizes (frames mixed per call of mix_audio callback)
+	constexpr uint32_t const MAX_MIX_SAMPLES = 1024; // that may be passed to Sound::init; n.b. SDL requires a power of two
+	constexpr float const MIN_RATE = 1.0f / 16.0f; //slowest playback rate (PlayingSample::set_rate)
+	constexpr float const MAX_RATE = 4.0f; //fastest playback rate
+	constexpr uint32_t const MAX_GROUPS = 16; //voice groups (see Sound::Group), including the default group
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//block size, chosen in Sound::init (fixed while the mixer runs):
+	uint32_t mix_samples = MAX_MIX_SAMPLES;
+	float block_seconds = float(MAX_MIX_SAMPLES) / float(AUDIO_RATE); //(block length; how far ramps advance each block)
+	float output_latency_ms = 0.0f; //see Sound::latency_ms
+
+	struct LR {
+		float l;
+		float r;
+	};
+	static_assert(sizeof(LR) == 8, "Sample is packed");
+
+	//...optionally with look-ahead (see Sound::init): a mixer thread runs mix_block a few blocks ahead
+	// of the device, and the device callback just copies finished audio out of a ring buffer:
+	uint32_t lookahead_blocks = 0; //(0: mix_block runs in the device callback)
+	RingBuffer< LR > mixed_audio(1); //mixer thread -> device callback
+	std::thread mixer_thread;
+	std::mutex mixer_mutex; //held by the mixer thread while it mixes (see Sound::lock)
+
+	//thread holding Sound::lock() (if any), and how many times it has locked -- the lock is recursive, as SDL_LockAudioDevice is:
+	// (while a thread holds it, the mixer can't run, so that thread may apply queued commands itself)
+	std::atomic< std::thread::id > lock_owner;
+	uint32_t lock_depth = 0;
+	std::condition_variable mixer_wake; //poked by the device callback when it takes audio
+	std::atomic< bool > mixer_quit{false};
+
+	//...or, when rendering offline (see Sound::init_offline), there is no device and mix_block is called from Sound::render:
+	bool offline = false;
+	LR offline_block[MAX_MIX_SAMPLES]; //most recently mixed block
+	uint32_t offline_block_used = 0; //frames of offline_block already copied out by render()
+
+	//The voice pool holds the playback state of every playing sample.
+	// It is allocated once (in Sound::init) and stored as parallel arrays indexed by voice slot,
+	// so the mixer never allocates and walks contiguous memory.
+	// Everything here except 'generation' belongs to the audio thread.
+	struct VoicePool {
+		enum Flags : uint8_t {
+			Loop = 1, //should playback loop after data runs out?
+			Is3D = 2, //use position/half_volume_radius (not pan) for panning?
+			Stopping = 4, //is playback fading out (after stop())?
+			Virtual = 8, //was voice skipped (not mixed) last block?
+			Fresh = 16, //has voice just started (so has no last block)?
+			Real = 32, //is voice being mixed this block?
+			Scheduled = 64, //was voice started with play_at? (if so, skip ahead when started late)
+		};
+
+		std::vector< void const * > data; //sample data being played
+		std::vector< Sound::Sample::Format > format; //...its format
+		std::vector< uint32_t > start; //...the first frame played (see Sound::Slice)
+		std::vector< uint32_t > size; //...the frame at which playback ends (or, if looping, wraps around)
+		std::vector< uint32_t > loop_start; //...and the frame it wraps around to
+		std::vector< OpusStream * > stream; //stream being played (instead of data), if any
+		std::vector< ModalSynth::Note const * > note; //note being synthesized (instead of data or stream), if any
+		std::vector< ModalSynth const * > synth; //...the instrument it belongs to
+		std::vector< float > partial_re, partial_im; //...its partials' phasors (ModalSynth::MaxPartials per voice)
+		std::vector< uint32_t > cursor; //next data value to read
+		std::vector< float > phase; //fractional part of playback position (between cursor and cursor+1), when resampling
+		std::vector< Sound::Ramp< float > > rate; //playback rate
+		std::vector< uint64_t > start_time; //sample time at which playback starts (may be in the current or a future block)
+		std::vector< uint8_t > flags;
+		std::vector< uint8_t > group; //voice group (index into mix_groups)
+		std::vector< uint32_t > group_stop_serial; //group's stop_serial when voice started
+
+		std::vector< Sound::Ramp< float > > volume;
+		std::vector< Sound::Ramp< float > > pan; //2D playback panning control
+		std::vector< Sound::Ramp< glm::vec3 > > position; //3D playback panning control
+		std::vector< Sound::Ramp< float > > half_volume_radius;
+		std::vector< float > priority; //voices with higher priority are made real first
+		std::vector< Sound::Ramp< float > > reverb_send; //how much goes to the reverb bus
+
+		//estimated loudness this block (used to pick which voices are mixed):
+		std::vector< float > loudness;
+
+		//gains at the start and end of the current mix block (computed before mixing):
+		std::vector< LR > start_gain;
+		std::vector< LR > end_gain;
+		//...and reverb send gains (the same for both ears):
+		std::vector< float > start_send;
+		std::vector< float > end_send;
+
+		//slot generation; incremented (by the audio thread) when a voice finishes, which invalidates old handles:
+		std::unique_ptr< std::atomic< uint32_t >[] > generation;
+
+		//slots currently playing, in the order they started:
+		std::vector< uint32_t > active;
+
+		//scratch list of voices audible this block (reserved to capacity, so never reallocates):
+		std::vector< uint32_t > audible;
+
+		//scratch space for computing the gains of every mixed voice in one batch (see mix_block):
+		std::vector< uint32_t > panned_3D, panned_2D; //voices being panned (reserved to capacity)
+		//per-voice inputs and outputs of the panning kernels (2 * capacity: block start values, then end values):
+		std::vector< float > pan_x, pan_y, pan_z, pan_half_radius;
+		std::vector< float > pan_amount, pan_gain;
+		std::vector< float > pan_left, pan_right;
+
+		uint32_t capacity = 0;
+
+		void allocate(uint32_t capacity_) {
+			capacity = capacity_;
+			data.assign(capacity, nullptr);
+			format.assign(capacity, Sound::Sample::F32);
+			start.assign(capacity, 0);
+			size.assign(capacity, 0);
+			loop_start.assign(capacity, 0);
+			stream.assign(capacity, nullptr);
+			note.assign(capacity, nullptr);
+			synth.assign(capacity, nullptr);
+			partial_re.assign(size_t(capacity) * ModalSynth::MaxPartials, 0.0f);
+			partial_im.assign(size_t(capacity) * ModalSynth::MaxPartials, 0.0f);
+			cursor.assign(capacity, 0);
+			phase.assign(capacity, 0.0f);
+			rate.assign(capacity, Sound::Ramp< float >(1.0f));
+			start_time.assign(capacity, 0);
+			flags.assign(capacity, 0);
+			group.assign(capacity, 0);
+			group_stop_serial.assign(capacity, 0);
+			volume.assign(capacity, Sound::Ramp< float >(0.0f));
+			pan.assign(capacity, Sound::Ramp< float >(0.0f));
+			position.assign(capacity, Sound::Ramp< glm::vec3 >(0.0f));
+			half_volume_radius.assign(capacity, Sound::Ramp< float >(1.0f));
+			priority.assign(capacity, 0.0f);
+			reverb_send.assign(capacity, Sound::Ramp< float >(0.0f));
+			loudness.assign(capacity, 0.0f);
+			start_gain.assign(capacity, LR{0.0f, 0.0f});
+			end_gain.assign(capacity, LR{0.0f, 0.0f});
+			start_send.assign(capacity, 0.0f);
+			end_send.assign(capacity, 0.0f);
+			generation.reset(new std::atomic< uint32_t >[capacity]);
+			for (uint32_t v = 0; v < capacity; ++v) generation[v].store(0, std::memory_order_relaxed);
+			active.clear();
+			active.reserve(capacity);
+			audible.clear();
+			audible.reserve(capacity);
+			panned_3D.clear();
+			panned_3D.reserve(capacity);
+			panned_2D.clear();
+			panned_2D.reserve(capacity);
+			for (auto *array : {&pan_x, &pan_y, &pan_z, &pan_half_radius, &pan_amount, &pan_gain, &pan_left, &pan_right}) {
+				array->assign(2 * capacity, 0.0f);
+			}
+		}
+	} voices;
+
+	//Commands sent from the game thread to the audio thread:
+	struct Command {
+		enum Type : uint8_t {
+			Play, //start playing voice
+			SetVolume, SetPan, SetPosition, SetHalfVolumeRadius, SetPriority, SetRate, SetReverbSend, Stop, //change a playing voice
+			SetGlobalVolume, SetListener, StopAll, SetVoiceLimits, SetReverb, SetReverbVolume, SetAnalyzer, //change global state
+			SetGroupVolume, PauseGroup, StopGroup, //change a voice group
+			ResetStats, SetStatsBudget, //change statistics
+			Retire, //stop using the objects named in the command, then acknowledge (see retire)
+		} type = Play;
+		uint8_t flags = 0; //VoicePool::Flags for 'Play'
+		uint8_t group = 0; //voice group for 'Play' and the group commands
+		uint32_t voice = -1U; //voice slot
+		uint32_t generation = 0; //voice slot generation (commands for stale generations are ignored)
+		void const *data = nullptr; //sample data for 'Play'
+		Sound::Sample::Format format = Sound::Sample::F32; //...its format
+		uint32_t size = 0; //...end frame (or max real voices for 'SetVoiceLimits')
+		uint32_t start = 0; //...first frame
+		uint32_t loop_start = 0; //...and frame to loop back to
+		OpusStream *stream = nullptr; //stream for 'Play' (if data is null) or 'Retire'
+		ModalSynth const *synth = nullptr; //instrument for 'Play' (if data and stream are null) or 'Retire'...
+		uint8_t note = 0; //...note to play on it
+		float velocity = 1.0f; //...and how hard
+		ConvolutionReverb *reverb = nullptr; //reverb for 'SetReverb' (may be null) or 'Retire'
+		SpectrumAnalyzer *analyzer = nullptr; //analyzer for 'SetAnalyzer' (may be null) or 'Retire'
+		uint64_t serial = 0; //for 'Retire': stored to retired_serial once the command is applied
+		uint64_t start_time = 0; //sample time to start 'Play' (only used with the Scheduled flag)
+		float value = 0.0f; //volume / pan / radius / priority / send / audibility threshold
+		float value2 = 0.0f; //initial volume for 'Play'
+		float rate = 1.0f; //initial playback rate for 'Play'
+		float ramp = 0.0f;
+		glm::vec3 position = glm::vec3(0.0f); //voice or listener position
+		glm::vec3 right = glm::vec3(0.0f); //listener right
+	};
+	//game thread -> audio thread; drained at the start of every mix_audio call:
+	RingBuffer< Command > commands(1024);
+
+	//audio thread -> game thread; voice slots that are free to use again:
+	RingBuffer< uint32_t > free_voices;
+
+	//audio thread -> game thread; serial of the last 'Retire' command applied (see retire):
+	std::atomic< uint64_t > retired_serial{0};
+	uint64_t next_retire_serial = 0; //(game thread)
+
+	//global values as seen by the mixer:
+	Sound::Ramp< float > mix_volume = Sound::Ramp< float >(1.0f);
+	Sound::Listener mix_listener;
+
+	//reverb bus as seen by the mixer:
+	ConvolutionReverb *mix_reverb = nullptr; //(owned by a Sound::Reverb)
+	Sound::Ramp< float > mix_reverb_volume = Sound::Ramp< float >(1.0f);
+	//voices' sends are mixed with the same gain in both channels (so the usual kernels can be used); only the left is convolved:
+	LR reverb_input[MAX_MIX_SAMPLES];
+	float reverb_mono[MAX_MIX_SAMPLES];
+	LR reverb_output[MAX_MIX_SAMPLES];
+
+	//spectrum analyzer (see Sound::start_analyzer) -- owned by the game thread, tapped by the mixer:
+	std::unique_ptr< SpectrumAnalyzer > analyzer;
+	SpectrumAnalyzer *mix_analyzer = nullptr; //(as seen by the mixer; changed by 'SetAnalyzer' and 'Retire' commands)
+
+	//voice groups as seen by the mixer:
+	struct MixGroup {
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+		bool paused = false;
+		float pause_gain = 1.0f; //goes to zero over one block when paused (and back when resumed)
+		uint32_t stop_serial = 0; //incremented by stop_group; voices started with an older serial are stopped
+		float stop_ramp = 0.0f;
+
+		//computed at the start of each block:
+		float start_gain = 1.0f; //volume * pause_gain at the start of the block
+		float end_gain = 1.0f; //...and at the end
+		bool held = false; //paused and faded out, so voices neither play nor advance
+	};
+	MixGroup mix_groups[MAX_GROUPS];
+	bool mix_groups_stopped = false; //was a group stopped since the last block?
+
+	//groups handed out by Sound::create_group (game thread):
+	uint32_t next_group = 1;
+
+	//voice limits as seen by the mixer:
+	uint32_t mix_max_real_voices = 64;
+	float mix_audibility_threshold = 1e-4f;
+
+	//inner mixing loops, selected for the running CPU in Sound::init():
+	MixMonoRampFn mix_mono_ramp = get_mix_kernel().mix_mono_ramp;
+	MixMonoRampS16Fn mix_mono_ramp_s16 = get_mix_kernel().mix_mono_ramp_s16;
+	ResampleFn resample = get_mix_kernel().resample;
+	PanGainsFn pan_gains = get_mix_kernel().pan_gains;
+	PanFrom3DFn pan_from_3D = get_mix_kernel().pan_from_3D;
+	OscillatorBankFn oscillator_bank = get_mix_kernel().oscillator_bank;
+
+	//source data for the resampler (when it can't read the sample data directly), and its output:
+	float resample_src[uint32_t(MAX_MIX_SAMPLES * MAX_RATE) + RESAMPLE_TAPS + 1];
+	float resample_data[MAX_MIX_SAMPLES];
+
+	//samples read from a stream (or decoded from ADPCM sample data), waiting to be mixed:
+	float decoded_data[MAX_MIX_SAMPLES];
+
+	//Mixer statistics. Only written by the audio thread; read by Sound::get_stats() on the game thread.
+	// (atomics so the game thread can read them without locking; relaxed, since each value stands alone)
+	struct MixStats {
+		//histogram of block mixing time: bin b holds times in [2^(b/8), 2^((b+1)/8)) microseconds:
+		static constexpr uint32_t const BinsPerOctave = 8;
+		static constexpr uint32_t const Bins = 24 * BinsPerOctave; //up to ~16 seconds
+		std::atomic< uint32_t > histogram[Bins];
+
+		std::atomic< uint64_t > blocks{0};
+		std::atomic< uint64_t > total_ns{0};
+		std::atomic< uint64_t > min_ns{0};
+		std::atomic< uint64_t > max_ns{0};
+		std::atomic< uint64_t > over_budget_blocks{0};
+		std::atomic< uint64_t > late_blocks{0};
+		std::atomic< uint32_t > active_voices{0};
+		std::atomic< uint32_t > real_voices{0};
+		std::atomic< uint32_t > peak_active_voices{0};
+		std::atomic< float > budget_ms{0.0f};
+
+		//audio thread only:
+		uint64_t budget_ns = 0;
+		std::chrono::steady_clock::time_point previous_start;
+		bool have_previous = false;
+
+		void reset() {
+			for (auto &bin : histogram) bin.store(0, std::memory_order_relaxed);
+			blocks.store(0, std::memory_order_relaxed);
+			total_ns.store(0, std::memory_order_relaxed);
+			min_ns.store(0, std::memory_order_relaxed);
+			max_ns.store(0, std::memory_order_relaxed);
+			over_budget_blocks.store(0, std::memory_order_relaxed);
+			late_blocks.store(0, std::memory_order_relaxed);
+			peak_active_voices.store(0, std::memory_order_relaxed);
+		}
+		void set_budget(float ms) {
+			budget_ms.store(ms, std::memory_order_relaxed);
+			budget_ns = uint64_t(std::max(0.0f, ms) * 1e6f);
+		}
+	} mix_stats;
+
+	//voices mixed (not virtual) in the current block:
+	uint32_t mix_real_voices = 0;
+
+	//sample time at the start of the block being mixed (audio thread only):
+	uint64_t mix_time = 0;
+	//sample time at the start of the next block whose commands haven't been applied yet (for the game thread):
+	std::atomic< uint64_t > next_block_time{0};
 
 }
 
@@ -36,24 +340,234 @@ Sound::Listener Sound::listener;
 //This audio-mixing callback is defined below:
 void mix_audio(void *, Uint8 *buffer_, int len);
 
+//...as is the function that actually mixes a block:
+void mix_block(LR *buffer);
+
+//...and the look-ahead mixer thread:
+static void mixer_thread_main();
+
+//game-thread helpers, also defined below:
+static void send_command(Command const &command);
+static void retire(Command command);
+
+//audio-thread helper, also defined below:
+void apply_commands();
+
 //------------------------ public-facing --------------------------------
 
-Sound::Sample::Sample(std::string const &filename) {
+//decode a sample file (through the cache) -- used by Sample(filename) and load_samples():
+static void load_sample_data(std::string const &filename, std::vector< float > *data) {
+	//n.b. decoder names are part of the cache key; change them if decoding changes:
 	if (filename.size() >= 4 && filename.substr(filename.size()-4) == ".wav") {
-		load_wav(filename, &data);
+		load_pcm_cached(filename, "load_wav f32 mono 48000Hz", load_wav, data);
 	} else if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
-		load_opus(filename, &data);
+		load_pcm_cached(filename, "load_opus f32 mono(average) 48000Hz", load_opus, data);
 	} else {
 		throw std::runtime_error("Sample '" + filename + "' doesn't end in either \".png\" or \".opus\" -- unsure how to load.");
 	}
 }
 
-Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
+Sound::Sample::Sample(std::string const &filename, Format format_) {
+	std::vector< float > decoded;
+	load_sample_data(filename, &decoded);
+	*this = Sample(std::move(decoded), format_);
+}
+
+Sound::Sample::Sample(std::vector< float > const &data_, Format format_) : Sample(std::vector< float >(data_), format_) {
+}
+
+Sound::Sample::Sample(std::vector< float > &&data_, Format format_) : format(format_) {
+	if (data_.size() > 0xffffffff) {
+		throw std::runtime_error("Sample has " + std::to_string(data_.size()) + " frames, which is more than can be played.");
+	}
+	if (format == F32) {
+		data = std::move(data_);
+	} else if (format == S16) {
+		//n.b. scaled by 32768 (as SDL does), so data that came from 16-bit files converts back exactly:
+		data_s16.resize(data_.size());
+		for (size_t i = 0; i < data_.size(); ++i) {
+			data_s16[i] = int16_t(std::max(-32768L, std::min(32767L, std::lround(data_[i] * 32768.0f))));
+		}
+	} else if (format == ADPCM) {
+		adpcm_frames = uint32_t(data_.size());
+		encode_adpcm(data_.data(), adpcm_frames, &data_adpcm);
+	} else {
+		throw std::runtime_error("Unknown sample format " + std::to_string(int(format)) + ".");
+	}
+}
+
+uint32_t Sound::Sample::frames() const {
+	if (format == S16) return uint32_t(data_s16.size());
+	else if (format == ADPCM) return adpcm_frames;
+	else return uint32_t(data.size());
 }
 
+size_t Sound::Sample::bytes() const {
+	return data.size() * sizeof(data[0]) + data_s16.size() * sizeof(data_s16[0]) + data_adpcm.size();
+}
+
+Sound::Slice::Slice(Sample const &sample_, uint32_t start_, uint32_t end_) : Slice(sample_, start_, end_, start_, end_) {
+}
 
+Sound::Slice::Slice(Sample const &sample_, uint32_t start_, uint32_t end_, uint32_t loop_start_, uint32_t loop_end_)
+	: sample(&sample_), start(start_), end(end_), loop_start(loop_start_), loop_end(loop_end_) {
+	uint32_t frames = sample->frames();
+	if (end == -1U) end = frames;
+	if (loop_end == -1U) loop_end = end;
+	if (!(start <= end && end <= frames)) {
+		throw std::runtime_error("Slice [" + std::to_string(start) + ", " + std::to_string(end) + ") doesn't fit in a sample of " + std::to_string(frames) + " frames.");
+	}
+	//(an empty slice is allowed -- it just doesn't play -- but its loop region can't be empty unless it is)
+	if (start < end && !(start <= loop_start && loop_start < loop_end && loop_end <= end)) {
+		throw std::runtime_error("Slice loop region [" + std::to_string(loop_start) + ", " + std::to_string(loop_end) + ") isn't within [" + std::to_string(start) + ", " + std::to_string(end) + ").");
+	}
+}
+
+std::vector< Sound::Sample > Sound::load_samples(std::vector< std::string > const &filenames, Sample::Format format) {
+	auto before = std::chrono::high_resolution_clock::now();
+
+	//decode on the shared pool (each item writes only its own slots):
+	std::vector< std::vector< float > > decoded(filenames.size());
+	std::vector< double > decode_ms(filenames.size(), 0.0);
+	ThreadPool::get_shared().parallel_for(uint32_t(filenames.size()), [&](uint32_t i) {
+		auto start = std::chrono::high_resolution_clock::now();
+		load_sample_data(filenames[i], &decoded[i]);
+		decode_ms[i] = std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - start).count();
+	});
+
+	double total_ms = std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+
+	//report from this thread, in order, so the output isn't interleaved:
+	double sum_ms = 0.0;
+	for (size_t i = 0; i < filenames.size(); ++i) {
+		std::cout << "  decoded '" << filenames[i] << "' (" << decoded[i].size() << " samples) in " << decode_ms[i] << " ms" << std::endl;
+		sum_ms += decode_ms[i];
+	}
+	std::cout << "Loaded " << filenames.size() << " samples in " << total_ms << " ms (" << sum_ms << " ms of decoding on " << ThreadPool::get_shared().thread_count() << " threads)." << std::endl;
+
+	std::vector< Sample > samples;
+	samples.reserve(decoded.size());
+	for (auto &data : decoded) {
+		samples.emplace_back(std::move(data), format);
+	}
+	return samples;
+}
+
+Sound::Reverb::Reverb(std::string const &filename) {
+	std::vector< float > response;
+	load_sample_data(filename, &response);
+	convolver.reset(new ConvolutionReverb(response, std::vector< float >(), mix_samples, get_mix_kernel()));
+}
+
+Sound::Reverb::Reverb(std::string const &left_filename, std::string const &right_filename) {
+	std::vector< float > left, right;
+	load_sample_data(left_filename, &left);
+	load_sample_data(right_filename, &right);
+	convolver.reset(new ConvolutionReverb(left, right, mix_samples, get_mix_kernel()));
+}
+
+Sound::Reverb::Reverb(std::vector< float > const &left, std::vector< float > const &right) {
+	convolver.reset(new ConvolutionReverb(left, right, mix_samples, get_mix_kernel()));
+}
+
+Sound::Reverb::~Reverb() {
+	//turn the reverb bus off if this is the reverb in use (and wait until the mixer has stopped convolving with it):
+	Command command;
+	command.reverb = convolver.get();
+	retire(command);
+}
+
+Sound::Instrument::Instrument() : synth(new ModalSynth()) {
+}
+
+Sound::Instrument::~Instrument() {
+	//cut off any notes still playing on it (and wait until the mixer has stopped synthesizing them):
+	Command command;
+	command.synth = synth.get();
+	retire(command);
+}
+
+Sound::Stream::Stream(std::string const &filename) {
+	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".opus") {
+		source.reset(new OpusStream(filename));
+	} else {
+		throw std::runtime_error("Stream '" + filename + "' doesn't end in \".opus\" -- only opus files can be streamed.");
+	}
+}
+
+Sound::Stream::~Stream() {
+	//cut off playback (and wait until the mixer has stopped reading from the decoder):
+	Command command;
+	command.stream = source.get();
+	retire(command);
+}
+
+void Sound::Stream::seek(float seconds) {
+	source->seek(uint64_t(std::max(0.0f, seconds) * float(AUDIO_RATE)));
+}
+
+
+
+//helper: put the mixer in its starting state (called before the audio thread exists):
+static void reset_mixer(uint32_t voice_capacity, uint32_t block_size) {
+	//block size: a power of two in [MIN_MIX_SAMPLES, MAX_MIX_SAMPLES]:
+	mix_samples = MIN_MIX_SAMPLES;
+	while (mix_samples < block_size && mix_samples < MAX_MIX_SAMPLES) mix_samples *= 2;
+	if (mix_samples != block_size) {
+		std::cerr << "WARNING: audio block size " << block_size << " isn't a power of two in [" << MIN_MIX_SAMPLES << ", " << MAX_MIX_SAMPLES << "]; using " << mix_samples << "." << std::endl;
+	}
+	block_seconds = float(mix_samples) / float(AUDIO_RATE);
+	output_latency_ms = 0.0f;
+
+	mix_mono_ramp = get_mix_kernel().mix_mono_ramp;
+	mix_mono_ramp_s16 = get_mix_kernel().mix_mono_ramp_s16;
+	resample = get_mix_kernel().resample;
+	pan_gains = get_mix_kernel().pan_gains;
+	pan_from_3D = get_mix_kernel().pan_from_3D;
+	oscillator_bank = get_mix_kernel().oscillator_bank;
+	get_resample_table(1.0f); //(builds the filter tables now, rather than on the audio thread)
+	std::cout << "Audio mixing kernel: " << get_mix_kernel().name << std::endl;
+
+	//allocate voice pool (safe to fill the free list from here, since there is no audio thread yet):
+	voices.allocate(voice_capacity);
+	free_voices.reset(voice_capacity);
+	for (uint32_t v = 0; v < voice_capacity; ++v) {
+		free_voices.push(v);
+	}
+
+	Command command;
+	while (commands.pop(&command)) { }
+
+	mix_volume = Sound::Ramp< float >(1.0f);
+	mix_listener = Sound::Listener();
+	for (auto &group : mix_groups) group = MixGroup();
+	mix_groups_stopped = false;
+	mix_reverb = nullptr;
+	mix_reverb_volume = Sound::Ramp< float >(1.0f);
+	mix_analyzer = analyzer.get(); //(so an analyzer started before init keeps running)
+	next_group = 1;
+	mix_max_real_voices = 64;
+	mix_audibility_threshold = 1e-4f;
+	Sound::volume = Sound::Ramp< float >(1.0f);
+	Sound::listener = Sound::Listener();
+
+	mix_time = 0;
+	next_block_time.store(0, std::memory_order_relaxed);
+	retired_serial.store(0, std::memory_order_relaxed);
+	next_retire_serial = 0;
+
+	mix_stats.reset();
+	mix_stats.set_budget(1000.0f * block_seconds);
+	mix_stats.have_previous = false;
+	mix_stats.active_voices.store(0, std::memory_order_relaxed);
+	mix_stats.real_voices.store(0, std::memory_order_relaxed);
+}
+
+void Sound::init(uint32_t voice_capacity, uint32_t lookahead_blocks_, uint32_t block_size) {
+	reset_mixer(voice_capacity, block_size);
+	assert(!mixer_thread.joinable() && "Sound::init called twice");
+	lookahead_blocks = std::min(lookahead_blocks_, 64u);
 
-void Sound::init() {
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
@@ -66,135 +580,516 @@ void Sound::init() {
 	want.freq = AUDIO_RATE;
 	want.format = AUDIO_F32SYS;
 	want.channels = 2;
-	want.samples = MIX_SAMPLES;
+	want.samples = Uint16(mix_samples);
 	want.callback = mix_audio;
 
 	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
+	if (device != 0 && (have.samples != want.samples || have.freq != want.freq)) {
+		//(shouldn't happen, since no changes were allowed -- SDL converts instead)
+		SDL_CloseAudioDevice(device);
+		device = 0;
+		SDL_SetError("device opened with %d frames at %dHz, not %d frames at %dHz", int(have.samples), have.freq, int(want.samples), want.freq);
+	}
 	if (device == 0) {
 		std::cerr << "Failed to open audio device:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
 	} else {
+		//a key press is heard after (at most) the block being played, plus any blocks mixed ahead,
+		// plus the block it is mixed into:
+		output_latency_ms = 1000.0f * float(have.samples) * float(2 + lookahead_blocks) / float(have.freq);
+		if (lookahead_blocks > 0) {
+			//start with a full buffer (of silence), so the device never starts out dry:
+			mixed_audio.reset(lookahead_blocks * mix_samples);
+			std::vector< LR > silence(lookahead_blocks * mix_samples, LR{0.0f, 0.0f});
+			mixed_audio.push_many(silence.data(), uint32_t(silence.size()));
+			mixer_quit.store(false, std::memory_order_relaxed);
+			mixer_thread = std::thread(mixer_thread_main);
+		}
 		//start audio playback:
 		SDL_PauseAudioDevice(device, 0);
-		std::cout << "Audio output initialized." << std::endl;
+		std::cout << "Audio output initialized (" << voice_capacity << " voices, " << have.samples << "-frame blocks at " << have.freq << "Hz";
+		if (lookahead_blocks > 0) std::cout << ", mixing " << lookahead_blocks << " blocks ahead";
+		std::cout << "; latency up to " << output_latency_ms << "ms plus device buffering)." << std::endl;
 	}
 }
 
 
+void Sound::init_offline(uint32_t voice_capacity, uint32_t block_size) {
+	assert(device == 0 && "can't render offline while an audio device is open");
+	reset_mixer(voice_capacity, block_size);
+	offline = true;
+	offline_block_used = mix_samples;
+}
+
+uint32_t Sound::block_size() {
+	return mix_samples;
+}
+
+float Sound::latency_ms() {
+	return output_latency_ms;
+}
+
+void Sound::render(float *out, uint32_t frames) {
+	assert(offline && "call Sound::init_offline() before Sound::render()");
+	assert(out || frames == 0);
+	while (frames > 0) {
+		if (offline_block_used == mix_samples) {
+			mix_block(offline_block);
+			offline_block_used = 0;
+		}
+		uint32_t count = std::min(frames, mix_samples - offline_block_used);
+		float const *block = &offline_block[0].l;
+		std::copy(block + 2 * offline_block_used, block + 2 * (offline_block_used + count), out);
+		offline_block_used += count;
+		out += 2 * count;
+		frames -= count;
+	}
+}
+
 void Sound::shutdown() {
+	stop_analyzer();
+	if (offline) {
+		offline = false;
+		//n.b. no audio thread, so it's fine to touch its data:
+		Command command;
+		while (commands.pop(&command)) { }
+		for (uint32_t v = 0; v < voices.capacity; ++v) {
+			voices.generation[v].fetch_add(1, std::memory_order_release);
+		}
+		voices.active.clear();
+	}
 	if (device != 0) {
 		//stop audio playback:
 		SDL_PauseAudioDevice(device, 1);
 		SDL_CloseAudioDevice(device);
 		device = 0;
+
+		//stop the mixer thread (if there is one):
+		if (mixer_thread.joinable()) {
+			mixer_quit.store(true, std::memory_order_relaxed);
+			{ //(taking the lock means the thread is either mixing or waiting, so the notify can't be missed)
+				std::lock_guard< std::mutex > lock(mixer_mutex);
+			}
+			mixer_wake.notify_one();
+			mixer_thread.join();
+			mixed_audio.reset(1);
+		}
+		lookahead_blocks = 0;
+
+		//the audio thread is gone; invalidate every handle so they all report 'stopped':
+		Command command;
+		while (commands.pop(&command)) { }
+		for (uint32_t v = 0; v < voices.capacity; ++v) {
+			voices.generation[v].fetch_add(1, std::memory_order_release);
+		}
+		voices.active.clear();
 	}
 }
 
 
 void Sound::lock() {
-	if (device) SDL_LockAudioDevice(device);
+	if (lock_owner.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+		lock_depth += 1;
+		return;
+	}
+	if (mixer_thread.joinable()) mixer_mutex.lock();
+	else if (device) SDL_LockAudioDevice(device);
+	lock_owner.store(std::this_thread::get_id(), std::memory_order_relaxed);
+	lock_depth = 1;
 }
 
 void Sound::unlock() {
-	if (device) SDL_UnlockAudioDevice(device);
+	assert(lock_owner.load(std::memory_order_relaxed) == std::this_thread::get_id() && lock_depth > 0 && "Sound::unlock() without Sound::lock()");
+	lock_depth -= 1;
+	if (lock_depth > 0) return;
+	lock_owner.store(std::thread::id(), std::memory_order_relaxed);
+	if (mixer_thread.joinable()) mixer_mutex.unlock();
+	else if (device) SDL_UnlockAudioDevice(device);
+}
+
+//helper: does this thread hold Sound::lock() (so the mixer can't be running)?
+static bool holding_lock() {
+	return lock_owner.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+//helper: claim a voice slot and tell the audio thread to start playing in it:
+// ('source' is a Play command with only what to play -- sample data, stream, or note -- filled in)
+// (if 'flags' includes Scheduled, playback starts at 'start_time')
+static std::shared_ptr< Sound::PlayingSample > start_voice(Command const &source, float play_volume, float pan, glm::vec3 const &position, float half_volume_radius, uint8_t flags, Sound::Group group, uint64_t start_time = 0, float rate = 1.0f) {
+	uint32_t voice = -1U;
+	uint32_t generation = 0;
+	if ((device || offline) && ((source.data && source.start < source.size) || source.stream || source.synth)) {
+		if (free_voices.pop(&voice)) {
+			generation = voices.generation[voice].load(std::memory_order_acquire);
+
+			Command command = source;
+			command.type = Command::Play;
+			command.flags = flags;
+			command.group = std::min< uint8_t >(group.index, MAX_GROUPS - 1);
+			command.voice = voice;
+			command.generation = generation;
+			command.start_time = start_time;
+			command.rate = rate;
+			command.value = (flags & VoicePool::Is3D ? half_volume_radius : pan);
+			command.value2 = play_volume;
+			command.position = position;
+			send_command(command);
+		} else {
+			static bool warned = false;
+			if (!warned) {
+				std::cerr << "WARNING: all " << voices.capacity << " voices are in use; new samples will not play. (Pass a larger voice capacity to Sound::init() to avoid this.)" << std::endl;
+				warned = true;
+			}
+		}
+	}
+	//n.b. when no voice was available, the handle reports 'stopped' and ignores changes:
+	return std::make_shared< Sound::PlayingSample >(voice, generation, (flags & VoicePool::Is3D) != 0);
+}
+
+//helper: source (for start_voice) that plays a slice:
+static Command slice_source(Sound::Slice const &slice, uint8_t flags) {
+	Command source;
+	Sound::Sample const &sample = *slice.sample;
+	source.format = sample.format;
+	if (sample.format == Sound::Sample::S16) source.data = sample.data_s16.data();
+	else if (sample.format == Sound::Sample::ADPCM) source.data = sample.data_adpcm.data();
+	else source.data = sample.data.data();
+	//(looping playback ends -- and wraps around -- at the end of the loop region)
+	source.size = (flags & VoicePool::Loop ? slice.loop_end : slice.end);
+	source.start = slice.start;
+	source.loop_start = slice.loop_start;
+	return source;
+}
+
+//helper: start_voice for samples:
+static std::shared_ptr< Sound::PlayingSample > start_sample(Sound::Slice const &slice, float play_volume, float pan, glm::vec3 const &position, float half_volume_radius, uint8_t flags, Sound::Group group) {
+	return start_voice(slice_source(slice, flags), play_volume, pan, position, half_volume_radius, flags, group);
+}
+
+//helper: start_voice for streams:
+static std::shared_ptr< Sound::PlayingSample > start_stream(Sound::Stream &stream, float play_volume, float pan, glm::vec3 const &position, float half_volume_radius, uint8_t flags, Sound::Group group) {
+	//n.b. the first play uses the data decoded when the stream was opened, so it starts right away:
+	if (stream.played) stream.source->seek(0);
+	stream.played = true;
+	stream.source->set_looping((flags & VoicePool::Loop) != 0);
+	Command source;
+	source.stream = stream.source.get();
+	return start_voice(source, play_volume, pan, position, half_volume_radius, flags, group);
+}
+
+//helper: start_voice for notes:
+static std::shared_ptr< Sound::PlayingSample > start_note(Sound::Instrument const &instrument, uint8_t note, float velocity, float play_volume, float pan, uint8_t flags, Sound::Group group, uint64_t start_time = 0) {
+	Command source;
+	source.synth = instrument.synth.get();
+	source.note = std::min< uint8_t >(note, 127);
+	source.velocity = velocity;
+	return start_voice(source, play_volume, pan, glm::vec3(0.0f), 0.0f, flags, group, start_time);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan, Group group) {
+	return start_sample(Slice(sample), play_volume, pan, glm::vec3(0.0f), 0.0f, 0, group);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start_sample(Slice(sample), play_volume, 0.0f, position, half_volume_radius, VoicePool::Is3D, group);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float play_volume, float pan, Group group) {
+	return start_sample(Slice(sample), play_volume, pan, glm::vec3(0.0f), 0.0f, VoicePool::Loop, group);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start_sample(Slice(sample), play_volume, 0.0f, position, half_volume_radius, VoicePool::Loop | VoicePool::Is3D, group);
+}
+
+uint64_t Sound::sample_time() {
+	return next_block_time.load(std::memory_order_acquire);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::play_at(uint64_t start_time, Sample const &sample, float play_volume, float pan, float rate, Group group) {
+	return start_voice(slice_source(Slice(sample), VoicePool::Scheduled), play_volume, pan, glm::vec3(0.0f), 0.0f, VoicePool::Scheduled, group, start_time, rate);
+}
+
+std::vector< std::shared_ptr< Sound::PlayingSample > > Sound::play_many(std::vector< Sample const * > const &samples, float play_volume, float pan, Group group) {
+	//n.b. commands may reach the mixer in different blocks, but they all name the same start frame:
+	uint64_t start_time = sample_time();
+	std::vector< std::shared_ptr< PlayingSample > > ret;
+	ret.reserve(samples.size());
+	for (Sample const *sample : samples) {
+		assert(sample);
+		ret.emplace_back(play_at(start_time, *sample, play_volume, pan, 1.0f, group));
+	}
+	return ret;
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::play_note(Instrument const &instrument, uint8_t note, float velocity, float play_volume, float pan, Group group) {
+	return start_note(instrument, note, velocity, play_volume, pan, 0, group);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+std::vector< std::shared_ptr< Sound::PlayingSample > > Sound::play_notes(Instrument const &instrument, std::vector< uint8_t > const &notes, float velocity, float play_volume, float pan, Group group) {
+	//(as in play_many, every note names the same start frame)
+	uint64_t start_time = sample_time();
+	std::vector< std::shared_ptr< PlayingSample > > ret;
+	ret.reserve(notes.size());
+	for (uint8_t note : notes) {
+		ret.emplace_back(start_note(instrument, note, velocity, play_volume, pan, VoicePool::Scheduled, group, start_time));
+	}
+	return ret;
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::play(Slice const &slice, float play_volume, float pan, Group group) {
+	return start_sample(slice, play_volume, pan, glm::vec3(0.0f), 0.0f, 0, group);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Slice const &slice, float play_volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start_sample(slice, play_volume, 0.0f, position, half_volume_radius, VoicePool::Is3D, group);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+std::shared_ptr< Sound::PlayingSample > Sound::play_at(uint64_t start_time, Slice const &slice, float play_volume, float pan, float rate, Group group) {
+	return start_voice(slice_source(slice, VoicePool::Scheduled), play_volume, pan, glm::vec3(0.0f), 0.0f, VoicePool::Scheduled, group, start_time, rate);
 }
 
+std::shared_ptr< Sound::PlayingSample > Sound::loop(Slice const &slice, float play_volume, float pan, Group group) {
+	return start_sample(slice, play_volume, pan, glm::vec3(0.0f), 0.0f, VoicePool::Loop, group);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Slice const &slice, float play_volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start_sample(slice, play_volume, 0.0f, position, half_volume_radius, VoicePool::Loop | VoicePool::Is3D, group);
+}
 
+std::shared_ptr< Sound::PlayingSample > Sound::play(Stream &stream, float play_volume, float pan, Group group) {
+	return start_stream(stream, play_volume, pan, glm::vec3(0.0f), 0.0f, 0, group);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Stream &stream, float play_volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start_stream(stream, play_volume, 0.0f, position, half_volume_radius, VoicePool::Is3D, group);
+}
+
+std::shared_ptr< Sound::PlayingSample > Sound::loop(Stream &stream, float play_volume, float pan, Group group) {
+	return start_stream(stream, play_volume, pan, glm::vec3(0.0f), 0.0f, VoicePool::Loop, group);
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Stream &stream, float play_volume, glm::vec3 const &position, float half_volume_radius, Group group) {
+	return start_stream(stream, play_volume, 0.0f, position, half_volume_radius, VoicePool::Loop | VoicePool::Is3D, group);
 }
 
 
 void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
+	Command command;
+	command.type = Command::StopAll;
+	send_command(command);
+}
+
+Sound::Group Sound::create_group() {
+	if (next_group >= MAX_GROUPS) {
+		throw std::runtime_error("Can't create more than " + std::to_string(MAX_GROUPS - 1) + " sound groups.");
 	}
-	unlock();
+	Group group;
+	group.index = uint8_t(next_group++);
+	return group;
+}
+
+//helper: send a command about a group:
+static void send_group_command(Sound::Group group, Command::Type type, float value, float ramp) {
+	assert(group.index < MAX_GROUPS);
+	Command command;
+	command.type = type;
+	command.group = group.index;
+	command.value = value;
+	command.ramp = ramp;
+	send_command(command);
+}
+
+void Sound::set_group_volume(Group group, float new_volume, float ramp) {
+	send_group_command(group, Command::SetGroupVolume, new_volume, ramp);
+}
+
+void Sound::pause_group(Group group) {
+	send_group_command(group, Command::PauseGroup, 1.0f, 0.0f);
+}
+
+void Sound::resume_group(Group group) {
+	send_group_command(group, Command::PauseGroup, 0.0f, 0.0f);
+}
+
+void Sound::stop_group(Group group, float ramp) {
+	send_group_command(group, Command::StopGroup, 0.0f, ramp);
+}
+
+void Sound::set_reverb(Reverb const *reverb, float return_volume) {
+	if (reverb && reverb->convolver->block > mix_samples) {
+		throw std::runtime_error("Reverb was made for " + std::to_string(reverb->convolver->block) + "-frame blocks, but the mixer uses " + std::to_string(mix_samples) + "-frame blocks; make reverbs after Sound::init().");
+	}
+	Command command;
+	command.type = Command::SetReverb;
+	command.reverb = (reverb ? reverb->convolver.get() : nullptr);
+	command.value = return_volume;
+	send_command(command);
+}
+
+void Sound::set_reverb_volume(float return_volume, float ramp) {
+	Command command;
+	command.type = Command::SetReverbVolume;
+	command.value = return_volume;
+	command.ramp = ramp;
+	send_command(command);
+}
+
+void Sound::start_analyzer(uint32_t fft_size, uint32_t bands) {
+	std::unique_ptr< SpectrumAnalyzer > old = std::move(analyzer);
+	analyzer = std::make_unique< SpectrumAnalyzer >(fft_size, bands);
+	Command command;
+	command.type = Command::SetAnalyzer;
+	command.analyzer = analyzer.get();
+	send_command(command);
+	if (old) {
+		//(the mixer has switched to the new analyzer by the time it applies this, so the old one can be destroyed after)
+		Command retired;
+		retired.analyzer = old.get();
+		retire(retired);
+	}
+}
+
+void Sound::stop_analyzer() {
+	if (!analyzer) return;
+	Command command;
+	command.analyzer = analyzer.get();
+	retire(command);
+	analyzer.reset();
+}
+
+void Sound::get_spectrum(std::vector< float > *levels) {
+	assert(levels);
+	if (analyzer) analyzer->get_bands(levels);
+	else levels->clear();
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
 	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.value = new_volume;
+	command.ramp = ramp;
+	send_command(command);
+}
+
+void Sound::set_voice_limits(uint32_t max_real_voices, float audibility_threshold) {
+	Command command;
+	command.type = Command::SetVoiceLimits;
+	command.size = max_real_voices;
+	command.value = audibility_threshold;
+	send_command(command);
+}
+
+Sound::Stats Sound::get_stats() {
+	Stats stats;
+	stats.blocks = mix_stats.blocks.load(std::memory_order_relaxed);
+	stats.deadline_ms = 1000.0f * block_seconds;
+	stats.budget_ms = mix_stats.budget_ms.load(std::memory_order_relaxed);
+	stats.over_budget_blocks = mix_stats.over_budget_blocks.load(std::memory_order_relaxed);
+	stats.late_blocks = mix_stats.late_blocks.load(std::memory_order_relaxed);
+	stats.active_voices = mix_stats.active_voices.load(std::memory_order_relaxed);
+	stats.real_voices = mix_stats.real_voices.load(std::memory_order_relaxed);
+	stats.peak_active_voices = mix_stats.peak_active_voices.load(std::memory_order_relaxed);
+	if (stats.blocks == 0) return stats;
+
+	stats.min_ms = float(mix_stats.min_ns.load(std::memory_order_relaxed)) * 1e-6f;
+	stats.max_ms = float(mix_stats.max_ns.load(std::memory_order_relaxed)) * 1e-6f;
+	stats.avg_ms = float(double(mix_stats.total_ns.load(std::memory_order_relaxed)) * 1e-6 / double(stats.blocks));
+
+	//p99 from the histogram (the audio thread may be adding to it, so count what's there):
+	uint32_t counts[MixStats::Bins];
+	uint64_t total = 0;
+	for (uint32_t b = 0; b < MixStats::Bins; ++b) {
+		counts[b] = mix_stats.histogram[b].load(std::memory_order_relaxed);
+		total += counts[b];
+	}
+	uint64_t below = total - total / 100; //blocks that should be at or under the 99th percentile
+	uint64_t seen = 0;
+	for (uint32_t b = 0; b < MixStats::Bins; ++b) {
+		seen += counts[b];
+		if (seen >= below) {
+			//report the top of the bin:
+			stats.p99_ms = 1e-3f * std::exp2(float(b + 1) / float(MixStats::BinsPerOctave));
+			break;
+		}
+	}
+	stats.p99_ms = std::min(std::max(stats.p99_ms, stats.min_ms), stats.max_ms);
+
+	return stats;
+}
+
+void Sound::reset_stats() {
+	Command command;
+	command.type = Command::ResetStats;
+	send_command(command);
+}
+
+void Sound::set_stats_budget(float budget_ms) {
+	Command command;
+	command.type = Command::SetStatsBudget;
+	command.value = budget_ms;
+	send_command(command);
 }
 
 //------------------
 
+//helper: send a command about a specific playing sample:
+static void send_voice_command(Sound::PlayingSample const &playing_sample, Command::Type type, float value, glm::vec3 const &position, float ramp) {
+	if (playing_sample.stopped()) return; //no need to send commands the audio thread will ignore
+	Command command;
+	command.type = type;
+	command.voice = playing_sample.voice;
+	command.generation = playing_sample.generation;
+	command.value = value;
+	command.position = position;
+	command.ramp = ramp;
+	send_command(command);
+}
+
 void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+	send_voice_command(*this, Command::SetVolume, new_volume, glm::vec3(0.0f), ramp);
 }
 
 void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+	if (is_3D) return; //ignore if not in '2D' mode
+	send_voice_command(*this, Command::SetPan, new_pan, glm::vec3(0.0f), ramp);
 }
 
 void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+	if (!is_3D) return; //ignore if not in '3D' mode
+	send_voice_command(*this, Command::SetPosition, 0.0f, new_position, ramp);
 }
 
 void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+	if (!is_3D) return; //ignore if not in '3D' mode
+	send_voice_command(*this, Command::SetHalfVolumeRadius, new_radius, glm::vec3(0.0f), ramp);
+}
+
+void Sound::PlayingSample::set_rate(float new_rate, float ramp) {
+	send_voice_command(*this, Command::SetRate, new_rate, glm::vec3(0.0f), ramp);
+}
+
+void Sound::PlayingSample::set_reverb_send(float new_send, float ramp) {
+	send_voice_command(*this, Command::SetReverbSend, new_send, glm::vec3(0.0f), ramp);
+}
+
+void Sound::PlayingSample::set_priority(float new_priority) {
+	send_voice_command(*this, Command::SetPriority, new_priority, glm::vec3(0.0f), 0.0f);
 }
 
 void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+	send_voice_command(*this, Command::Stop, 0.0f, glm::vec3(0.0f), ramp);
+}
+
+bool Sound::PlayingSample::stopped() const {
+	if (voice >= voices.capacity) return true;
+	return voices.generation[voice].load(std::memory_order_acquire) != generation;
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
 	position.set(new_position, ramp);
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
@@ -202,83 +1097,88 @@ void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec
 	} else {
 		right.set(glm::normalize(new_right), ramp);
 	}
-	Sound::unlock();
+	Command command;
+	command.type = Command::SetListener;
+	command.position = position.target;
+	command.right = right.target;
+	command.ramp = ramp;
+	send_command(command);
 }
 
-//------------------------ internals --------------------------------
-
+//------------------
 
-//helper: equal-power panning
-inline void compute_pan_weights(float pan, float *left, float *right) {
-	//clamp pan to -1 to 1 range:
-	pan = std::max(-1.0f, std::min(1.0f, pan));
-
-	//want left^2 + right^2 = 1.0, so use angles:
-	float ang = 0.5f * 3.1415926f * (0.5f * (pan + 1.0f));
-	*left = std::cos(ang);
-	*right = std::sin(ang);
-}
-
-//helper: 3D audio panning
-void compute_pan_from_listener_and_position(
-	glm::vec3 const &listener_position,
-	glm::vec3 const &listener_right,
-	glm::vec3 const &source_position,
-	float source_half_radius,
-	float *left, float *right
-	) {
-	glm::vec3 to = source_position - listener_position;
-	float distance = glm::length(to);
-	//start by panning based on direction.
-	//note that for a LR fade to sound uniform, sound power (squared magnitude) should remain constant.
-	if (distance == 0.0f) {
-		*left = *right = std::sqrt(2.0f);
-	} else {
-		//amt ranges from -1 (most left) to 1 (most right):
-		float amt = glm::dot(listener_right, to) / distance;
-		//turn into an angle from 0.0f (most left) to pi/2 (most right):
-		float ang = 0.5f * 3.1415926f * (0.5f * (amt + 1.0f));
-		*left = std::cos(ang);
-		*right = std::sin(ang);
+void send_command(Command const &command) {
+	if (offline) {
+		//mix_audio runs on this thread, so the queue can be drained right here if it fills up:
+		if (!commands.push(command)) {
+			apply_commands();
+			bool pushed = commands.push(command);
+			assert(pushed); (void)pushed;
+		}
+		return;
+	}
+	if (!device) return; //no audio thread to receive commands
+	while (!commands.push(command)) {
+		//queue is full (a very large burst of commands)...
+		if (holding_lock()) {
+			//...and the audio thread is locked out, so drain it here:
+			apply_commands();
+		} else {
+			//...so wait for the audio thread to drain it:
+			std::this_thread::yield();
+		}
+	}
+}
 
-		//squared distance attenuation is realistic if there are no walls,
-		// but I'm going to use linear because it's sounds better to me.
-		// (feel free to change it, of course)
-		//want att = 0.5f at distance == half_volume_radius
-		float att = 1.0f / (1.0f + (distance / source_half_radius));
-		*left *= att;
-		*right *= att;
+//'command' names objects the mixer may be using (e.g., 'reverb'); once this returns, the mixer has let go of them:
+// (waits for the audio thread to apply the command -- usually a block or less)
+void retire(Command command) {
+	command.type = Command::Retire;
+	if (offline || (device && holding_lock())) {
+		//mix_block runs on this thread (or is locked out), so it isn't running now; just apply the command (and any queued before it):
+		send_command(command);
+		apply_commands();
+		return;
+	}
+	if (!device) return; //no audio thread, so nothing to wait for
+	command.serial = ++next_retire_serial;
+	send_command(command);
+	while (retired_serial.load(std::memory_order_acquire) < command.serial) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
 	}
 }
 
+//------------------------ internals --------------------------------
+
+
 //helper: ramp updates...
-constexpr float const RAMP_STEP = float(MIX_SAMPLES) / float(AUDIO_RATE);
+// (ramps advance by the length of a block in seconds, so they take the same time whatever the block size)
 
 //helper: ...for single values:
 void step_value_ramp(Sound::Ramp< float > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+	if (ramp.ramp < block_seconds) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value += (RAMP_STEP / ramp.ramp) * (ramp.target - ramp.value);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value += (block_seconds / ramp.ramp) * (ramp.target - ramp.value);
+		ramp.ramp -= block_seconds;
 	}
 }
 
 //helper: ...for 3D positions:
 void step_position_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+	if (ramp.ramp < block_seconds) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
-		ramp.value = glm::mix(ramp.value, ramp.target, RAMP_STEP / ramp.ramp);
-		ramp.ramp -= RAMP_STEP;
+		ramp.value = glm::mix(ramp.value, ramp.target, block_seconds / ramp.ramp);
+		ramp.ramp -= block_seconds;
 	}
 }
 
 //helper: ...for 3D directions:
 void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
-	if (ramp.ramp < RAMP_STEP) {
+	if (ramp.ramp < block_seconds) {
 		ramp.value = ramp.target;
 		ramp.ramp = 0.0f;
 	} else {
@@ -302,137 +1202,706 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 		float angle = std::acos(glm::clamp(glm::dot(ramp.value, ramp.target), -1.0f, 1.0f));
 
 		//figure out new target value by moving angle toward target:
-		angle *= (ramp.ramp - RAMP_STEP) / ramp.ramp;
+		angle *= (ramp.ramp - block_seconds) / ramp.ramp;
 
 		ramp.value = ramp.target * std::cos(angle) + perp * std::sin(angle);
-		ramp.ramp -= RAMP_STEP;
+		ramp.ramp -= block_seconds;
+	}
+}
+
+
+
+//helper: start fading out a voice:
+void stop_voice(uint32_t v, float ramp) {
+	if (!(voices.flags[v] & VoicePool::Stopping)) {
+		voices.flags[v] |= VoicePool::Stopping;
+		voices.volume[v].target = 0.0f;
+		voices.volume[v].ramp = ramp;
+	} else {
+		voices.volume[v].ramp = std::min(voices.volume[v].ramp, ramp);
+	}
+}
+
+//helper: apply all commands queued by the game thread:
+void apply_commands() {
+	Command command;
+	while (commands.pop(&command)) {
+		uint32_t v = command.voice;
+		if (command.type == Command::Play) {
+			assert(v < voices.capacity);
+			assert(voices.generation[v].load(std::memory_order_relaxed) == command.generation);
+			voices.data[v] = command.data;
+			voices.format[v] = command.format;
+			voices.start[v] = command.start;
+			voices.size[v] = command.size;
+			voices.loop_start[v] = command.loop_start;
+			voices.stream[v] = command.stream;
+			voices.note[v] = nullptr;
+			voices.synth[v] = command.synth;
+			if (command.synth) {
+				voices.note[v] = &command.synth->start(command.note, command.velocity, &voices.partial_re[v * ModalSynth::MaxPartials], &voices.partial_im[v * ModalSynth::MaxPartials]);
+			}
+			voices.cursor[v] = command.start;
+			voices.phase[v] = 0.0f;
+			voices.rate[v] = Sound::Ramp< float >(std::max(MIN_RATE, std::min(MAX_RATE, command.rate)));
+			voices.flags[v] = command.flags | VoicePool::Fresh;
+			voices.group[v] = command.group;
+			voices.group_stop_serial[v] = mix_groups[command.group].stop_serial;
+			voices.start_time[v] = mix_time;
+			if (command.flags & VoicePool::Scheduled) {
+				if (command.start_time >= mix_time) {
+					voices.start_time[v] = command.start_time;
+				} else if (command.data) {
+					//request arrived late; skip ahead as if it had started on time:
+					uint64_t late = uint64_t(double(mix_time - command.start_time) * double(voices.rate[v].value));
+					uint64_t length = command.size - command.start;
+					if (late < length) {
+						voices.cursor[v] = uint32_t(command.start + late);
+					} else if (command.flags & VoicePool::Loop) {
+						voices.cursor[v] = uint32_t(command.loop_start + (late - length) % (command.size - command.loop_start));
+					} else {
+						//...which means it's already over:
+						voices.generation[v].fetch_add(1, std::memory_order_release);
+						bool pushed = free_voices.push(v);
+						assert(pushed && "free list has room for every voice"); (void)pushed;
+						continue;
+					}
+				} else if (voices.note[v]) {
+					ModalSynth::advance(*voices.note[v], &voices.partial_re[v * ModalSynth::MaxPartials], &voices.partial_im[v * ModalSynth::MaxPartials], mix_time - command.start_time);
+				}
+			}
+			voices.volume[v] = Sound::Ramp< float >(command.value2);
+			voices.priority[v] = 0.0f;
+			voices.reverb_send[v] = Sound::Ramp< float >(0.0f);
+			if (command.flags & VoicePool::Is3D) {
+				voices.position[v] = Sound::Ramp< glm::vec3 >(command.position);
+				voices.half_volume_radius[v] = Sound::Ramp< float >(command.value);
+			} else {
+				voices.pan[v] = Sound::Ramp< float >(command.value);
+			}
+			voices.active.emplace_back(v); //(never reallocates: reserved to capacity)
+		} else if (command.type == Command::SetGlobalVolume) {
+			mix_volume.set(command.value, command.ramp);
+		} else if (command.type == Command::SetListener) {
+			mix_listener.position.set(command.position, command.ramp);
+			mix_listener.right.set(command.right, command.ramp);
+		} else if (command.type == Command::StopAll) {
+			//(stops every group, so costs the same however many voices are playing)
+			for (auto &group : mix_groups) {
+				group.stop_serial += 1;
+				group.stop_ramp = 1.0f / 60.0f;
+			}
+			mix_groups_stopped = true;
+		} else if (command.type == Command::SetGroupVolume) {
+			mix_groups[command.group].volume.set(command.value, command.ramp);
+		} else if (command.type == Command::PauseGroup) {
+			mix_groups[command.group].paused = (command.value != 0.0f);
+		} else if (command.type == Command::StopGroup) {
+			mix_groups[command.group].stop_serial += 1;
+			mix_groups[command.group].stop_ramp = command.ramp;
+			mix_groups_stopped = true;
+		} else if (command.type == Command::SetReverb) {
+			mix_reverb = command.reverb;
+			if (mix_reverb) mix_reverb->reset(); //(may have a tail left from earlier use)
+			mix_reverb_volume = Sound::Ramp< float >(command.value);
+		} else if (command.type == Command::SetReverbVolume) {
+			mix_reverb_volume.set(command.value, command.ramp);
+		} else if (command.type == Command::SetAnalyzer) {
+			mix_analyzer = command.analyzer;
+		} else if (command.type == Command::SetVoiceLimits) {
+			mix_max_real_voices = command.size;
+			mix_audibility_threshold = command.value;
+		} else if (command.type == Command::ResetStats) {
+			mix_stats.reset();
+		} else if (command.type == Command::SetStatsBudget) {
+			mix_stats.set_budget(command.value);
+		} else if (command.type == Command::Retire) {
+			//(commands are applied before anything is mixed, so nothing from the last block still refers to these)
+			if (command.reverb && command.reverb == mix_reverb) mix_reverb = nullptr;
+			if (command.analyzer && command.analyzer == mix_analyzer) mix_analyzer = nullptr;
+			if (command.synth || command.stream) {
+				//cut off every note playing on the instrument, or voice playing the stream (including any started by commands just applied):
+				uint32_t still_active = 0;
+				for (uint32_t voice : voices.active) {
+					if ((command.synth && voices.synth[voice] == command.synth)
+					 || (command.stream && voices.stream[voice] == command.stream)) {
+						voices.generation[voice].fetch_add(1, std::memory_order_release);
+						bool pushed = free_voices.push(voice);
+						assert(pushed && "free list has room for every voice"); (void)pushed;
+					} else {
+						voices.active[still_active++] = voice;
+					}
+				}
+				voices.active.resize(still_active);
+			}
+			retired_serial.store(command.serial, std::memory_order_release);
+		} else {
+			//remaining commands refer to a voice, which may have finished since the command was sent:
+			assert(v < voices.capacity);
+			if (voices.generation[v].load(std::memory_order_relaxed) != command.generation) continue;
+
+			if (command.type == Command::SetVolume) {
+				if (!(voices.flags[v] & VoicePool::Stopping)) {
+					voices.volume[v].set(command.value, command.ramp);
+				}
+			} else if (command.type == Command::SetPan) {
+				voices.pan[v].set(command.value, command.ramp);
+			} else if (command.type == Command::SetPosition) {
+				voices.position[v].set(command.position, command.ramp);
+			} else if (command.type == Command::SetHalfVolumeRadius) {
+				voices.half_volume_radius[v].set(command.value, command.ramp);
+			} else if (command.type == Command::SetRate) {
+				voices.rate[v].set(std::max(MIN_RATE, std::min(MAX_RATE, command.value)), command.ramp);
+			} else if (command.type == Command::SetReverbSend) {
+				voices.reverb_send[v].set(std::max(0.0f, command.value), command.ramp);
+			} else if (command.type == Command::SetPriority) {
+				voices.priority[v] = command.value;
+			} else if (command.type == Command::Stop) {
+				stop_voice(v, command.ramp);
+			} else {
+				assert(0 && "unknown command type");
+			}
+		}
+	}
+}
+
+//helper: convert frames [first, first + count) of a voice's sample data (which must all be in range) to floating point:
+static void read_frames(uint32_t v, uint32_t first, uint32_t count, float *out) {
+	assert(uint64_t(first) + count <= voices.size[v]);
+	Sound::Sample::Format format = voices.format[v];
+	if (format == Sound::Sample::S16) {
+		int16_t const *data = static_cast< int16_t const * >(voices.data[v]) + first;
+		for (uint32_t i = 0; i < count; ++i) {
+			out[i] = float(data[i]) * (1.0f / 32768.0f);
+		}
+	} else if (format == Sound::Sample::ADPCM) {
+		decode_adpcm(static_cast< uint8_t const * >(voices.data[v]), first, count, out);
+	} else {
+		std::copy_n(static_cast< float const * >(voices.data[v]) + first, count, out);
+	}
+}
+
+//helper: mix 'count' frames of voice 'v' from 'src' (float or 16-bit) into 'buffer', starting 'at' frames into the block,
+// with gains ramping from 'pan' by 'pan_step' per frame -- and into the reverb bus, if the voice sends to it:
+template< typename T >
+void mix_voice_run(uint32_t v, T const *src, uint32_t count, uint32_t at, LR pan, LR pan_step, LR *buffer) {
+	auto mix = [&](LR *dst, float left, float right, float left_step, float right_step) {
+		if constexpr (std::is_same< T, int16_t >::value) {
+			mix_mono_ramp_s16(src, count, &dst[at].l, left + float(at) * left_step, right + float(at) * right_step, left_step, right_step);
+		} else {
+			mix_mono_ramp(src, count, &dst[at].l, left + float(at) * left_step, right + float(at) * right_step, left_step, right_step);
+		}
+	};
+	mix(buffer, pan.l, pan.r, pan_step.l, pan_step.r);
+	if (mix_reverb && (voices.start_send[v] != 0.0f || voices.end_send[v] != 0.0f)) {
+		float send_step = (voices.end_send[v] - voices.start_send[v]) / float(mix_samples);
+		mix(reverb_input, voices.start_send[v], voices.start_send[v], send_step, send_step);
+	}
+}
+
+//helper: play (or, if !mix, just advance) a sample voice through the resampler, starting 'offset' frames into the block;
+// returns true if the voice reached the end of its data:
+bool mix_resampled(uint32_t v, uint32_t offset, bool mix, LR pan, LR pan_step, LR *buffer) {
+	uint32_t const data_size = voices.size[v];
+	uint32_t const data_start = voices.start[v];
+	uint32_t const loop_start = voices.loop_start[v];
+	bool const loop = (voices.flags[v] & VoicePool::Loop) != 0;
+	float const rate = voices.rate[v].value;
+	//once playback is inside the loop region, the frames before it are the end of the loop (rather than silence or the intro):
+	bool const wrap_back = loop && voices.cursor[v] >= loop_start;
+	int64_t const lowest = (wrap_back ? loop_start : data_start); //(first frame that may be read directly)
+
+	double position = double(voices.cursor[v]) + double(voices.phase[v]);
+	uint32_t count = mix_samples - offset;
+	if (!loop) {
+		//don't play past the end of the data:
+		count = uint32_t(std::min(double(count), std::ceil((double(data_size) - position) / double(rate))));
+	}
+
+	if (mix && count > 0) {
+		//the filter reads source frames [first, first + span):
+		double whole = std::floor(position);
+		float frac = float(position - whole);
+		int64_t first = int64_t(whole) - int64_t(RESAMPLE_TAPS / 2 - 1);
+		uint32_t span = uint32_t(frac + float(count - 1) * rate) + RESAMPLE_TAPS + 1;
+		assert(span <= sizeof(resample_src) / sizeof(resample_src[0]));
+
+		float const *src;
+		if (voices.format[v] == Sound::Sample::F32 && first >= lowest && first + span <= data_size) {
+			src = static_cast< float const * >(voices.data[v]) + first; //entirely within (floating point) data, so read directly
+		} else {
+			//gather, converting from the sample's format (wrapping around the loop region if looping, padding with silence if not):
+			int64_t const loop_length = int64_t(data_size) - loop_start;
+			for (uint32_t i = 0; i < span; /* later */) {
+				int64_t at = first + int64_t(i);
+				if (loop && (at >= int64_t(data_size) || (wrap_back && at < loop_start))) {
+					at = (at - loop_start) % loop_length;
+					if (at < 0) at += loop_length;
+					at += loop_start;
+				} else if (at < int64_t(data_start) || at >= int64_t(data_size)) {
+					resample_src[i] = 0.0f;
+					i += 1;
+					continue;
+				}
+				uint32_t run = uint32_t(std::min(int64_t(span - i), int64_t(data_size) - at));
+				read_frames(v, uint32_t(at), run, resample_src + i);
+				i += run;
+			}
+			src = resample_src;
+		}
+
+		resample(get_resample_table(rate), src, frac, rate, count, resample_data);
+		mix_voice_run(v, resample_data, count, offset, pan, pan_step, buffer);
+	}
+
+	//update position in sample:
+	position += double(count) * double(rate);
+	if (loop) {
+		if (position >= double(data_size)) {
+			position = double(loop_start) + std::fmod(position - double(loop_start), double(data_size - loop_start));
+		}
+	} else if (position >= double(data_size)) {
+		return true;
+	}
+	double whole = std::floor(position);
+	voices.cursor[v] = uint32_t(whole);
+	voices.phase[v] = float(position - whole);
+	if (voices.cursor[v] >= data_size) { //(rounding)
+		voices.cursor[v] = loop_start;
+		voices.phase[v] = 0.0f;
 	}
+	return false;
+}
+
+//helper: was voice mixed in the previous block? (new voices count as whatever they are now, so they don't fade in)
+inline bool was_real_last_block(uint32_t v) {
+	uint8_t flags = voices.flags[v];
+	if (flags & VoicePool::Fresh) return (flags & VoicePool::Real) != 0;
+	return (flags & VoicePool::Virtual) == 0;
 }
 
+//helper: is voice 'v' in a paused (and faded-out) group? Such voices neither play nor advance.
+// (voices that were stopped keep going, so they can finish fading out and free their slot)
+inline bool voice_held(uint32_t v) {
+	return mix_groups[voices.group[v]].held && !(voices.flags[v] & VoicePool::Stopping);
+}
+
+//helper: mark (with VoicePool::Real) the voices that should be mixed this block:
+// voices quieter than the audibility threshold are skipped, and at most mix_max_real_voices
+// of the rest are kept, most important (by priority, then loudness) first.
+void choose_real_voices(glm::vec3 const &listener_position, float global_volume) {
+	voices.audible.clear();
+	for (uint32_t v : voices.active) {
+		voices.flags[v] &= uint8_t(~VoicePool::Real);
+		if (voices.start_time[v] >= mix_time + mix_samples) continue; //hasn't started yet
+		if (voice_held(v)) continue; //group is paused
+
+		MixGroup const &group = mix_groups[voices.group[v]];
+		float loudness = global_volume * std::max(group.start_gain, group.end_gain) * std::max(voices.volume[v].value, voices.volume[v].target);
+		if (voices.flags[v] & VoicePool::Is3D) {
+			//same distance attenuation as the mix kernel's pan_from_3D, without the panning:
+			float distance = glm::length(voices.position[v].value - listener_position);
+			loudness *= 1.0f / (1.0f + (distance / voices.half_volume_radius[v].value));
+		}
+		voices.loudness[v] = loudness;
+
+		if (loudness >= mix_audibility_threshold) {
+			voices.audible.emplace_back(v); //(never reallocates: reserved to capacity)
+		}
+	}
+
+	if (voices.audible.size() > mix_max_real_voices) {
+		std::nth_element(voices.audible.begin(), voices.audible.begin() + mix_max_real_voices, voices.audible.end(),
+			[](uint32_t a, uint32_t b) {
+				if (voices.priority[a] != voices.priority[b]) return voices.priority[a] > voices.priority[b];
+				return voices.loudness[a] > voices.loudness[b];
+			}
+		);
+		voices.audible.resize(mix_max_real_voices);
+	}
+
+	for (uint32_t v : voices.audible) {
+		voices.flags[v] |= VoicePool::Real;
+	}
+	mix_real_voices = uint32_t(voices.audible.size());
+}
+
+//helper: add the block that started at 'start' to the mixer statistics:
+void record_block_stats(std::chrono::steady_clock::time_point start, uint32_t active_voices) {
+	auto end = std::chrono::steady_clock::now();
+	uint64_t ns = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(end - start).count());
+
+	//(only this thread writes these, so load + store is enough)
+	auto bump = [](std::atomic< uint64_t > &value) {
+		value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	};
+
+	uint64_t blocks = mix_stats.blocks.load(std::memory_order_relaxed);
+	if (blocks == 0 || ns < mix_stats.min_ns.load(std::memory_order_relaxed)) mix_stats.min_ns.store(ns, std::memory_order_relaxed);
+	if (ns > mix_stats.max_ns.load(std::memory_order_relaxed)) mix_stats.max_ns.store(ns, std::memory_order_relaxed);
+	mix_stats.total_ns.store(mix_stats.total_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+	if (ns > mix_stats.budget_ns) bump(mix_stats.over_budget_blocks);
+
+	//callbacks should arrive once per block; one that comes much later means the device ran out of audio:
+	// (offline rendering isn't real-time, so doesn't count; with look-ahead, mix_audio counts dropouts itself)
+	if (!offline && lookahead_blocks == 0) {
+		if (mix_stats.have_previous) {
+			auto gap = std::chrono::duration< float >(start - mix_stats.previous_start).count();
+			if (gap > 2.0f * block_seconds) bump(mix_stats.late_blocks);
+		}
+		mix_stats.previous_start = start;
+		mix_stats.have_previous = true;
+	}
+
+	float us = float(ns) * 1e-3f;
+	uint32_t bin = 0;
+	if (us > 1.0f) {
+		bin = std::min(uint32_t(std::log2(us) * float(MixStats::BinsPerOctave)), MixStats::Bins - 1);
+	}
+	mix_stats.histogram[bin].store(mix_stats.histogram[bin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+	mix_stats.active_voices.store(active_voices, std::memory_order_relaxed);
+	mix_stats.real_voices.store(mix_real_voices, std::memory_order_relaxed);
+	if (active_voices > mix_stats.peak_active_voices.load(std::memory_order_relaxed)) {
+		mix_stats.peak_active_voices.store(active_voices, std::memory_order_relaxed);
+	}
+
+	mix_stats.blocks.store(blocks + 1, std::memory_order_relaxed);
+}
 
 //The audio callback -- invoked by SDL when it needs more sound to play:
 void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(buffer_); //should always have some audio buffer
 
-	struct LR {
-		float l;
-		float r;
-	};
-	static_assert(sizeof(LR) == 8, "Sample is packed");
-	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
+	assert(size_t(len) == mix_samples * sizeof(LR)); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
+	if (lookahead_blocks == 0) {
+		mix_block(buffer);
+		return;
+	}
+
+	//look-ahead: the block was (hopefully) already mixed by the mixer thread:
+	uint32_t got = mixed_audio.pop_many(buffer, mix_samples);
+	mixer_wake.notify_one(); //(made room for another block)
+	if (got < mix_samples) {
+		//mixer thread fell behind; play silence for the rest (an audible dropout):
+		std::fill(buffer + got, buffer + mix_samples, LR{0.0f, 0.0f});
+		mix_stats.late_blocks.store(mix_stats.late_blocks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+}
+
+//The look-ahead mixer thread -- keeps 'mixed_audio' topped up with lookahead_blocks blocks:
+void mixer_thread_main() {
+	LR block[MAX_MIX_SAMPLES];
+	//wait at most a quarter block between checks (in case a poke from the callback is missed):
+	auto const poll = std::chrono::microseconds(1000000 * mix_samples / AUDIO_RATE / 4);
+
+	std::unique_lock< std::mutex > lock(mixer_mutex);
+	while (!mixer_quit.load(std::memory_order_relaxed)) {
+		if (mixed_audio.size() + mix_samples <= lookahead_blocks * mix_samples) {
+			mix_block(block);
+			uint32_t pushed = mixed_audio.push_many(block, mix_samples);
+			assert(pushed == mix_samples && "ring has room for a block"); (void)pushed;
+		} else {
+			mixer_wake.wait_for(lock, poll);
+		}
+	}
+}
+
+//Mix one block of audio into 'buffer' -- called from mix_audio, the mixer thread, or Sound::render:
+void mix_block(LR *buffer) {
+	auto block_start = std::chrono::steady_clock::now();
+
 	//zero the output buffer:
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < mix_samples; ++s) {
 		buffer[s].l = 0.0f;
 		buffer[s].r = 0.0f;
 	}
+	std::fill(reverb_input, reverb_input + mix_samples, LR{0.0f, 0.0f});
+
+	//pick up any changes from the game thread:
+	apply_commands();
+	//(anything the game thread sends from now on will be applied in the next block)
+	next_block_time.store(mix_time + mix_samples, std::memory_order_release);
 
 	//update global values:
-	float start_volume = Sound::volume.value;
-	glm::vec3 start_position =  Sound::listener.position.value;
-	glm::vec3 start_right =  Sound::listener.right.value;
-
-	step_value_ramp(Sound::volume);
-	step_position_ramp( Sound::listener.position);
-	step_direction_ramp( Sound::listener.right);
-
-	float end_volume = Sound::volume.value;
-	glm::vec3 end_position =  Sound::listener.position.value;
-	glm::vec3 end_right =  Sound::listener.right.value;
-
-	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
-
-		//Figure out sample panning/volume at start...
-		LR start_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
-			//3D panning
-			compute_pan_from_listener_and_position(
-				start_position, start_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&start_pan.l, &start_pan.r);
-
-			step_position_ramp(playing_sample.position);
-			step_value_ramp(playing_sample.half_volume_radius);
-		} else {
-			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &start_pan.l, &start_pan.r);
+	float start_volume = mix_volume.value;
+	glm::vec3 start_position = mix_listener.position.value;
+	glm::vec3 start_right = mix_listener.right.value;
+
+	step_value_ramp(mix_volume);
+	step_position_ramp(mix_listener.position);
+	step_direction_ramp(mix_listener.right);
+
+	float end_volume = mix_volume.value;
+	glm::vec3 end_position = mix_listener.position.value;
+	glm::vec3 end_right = mix_listener.right.value;
+
+	//update groups (pausing or resuming fades over one block):
+	for (auto &group : mix_groups) {
+		float start_pause = group.pause_gain;
+		group.pause_gain = (group.paused ? 0.0f : 1.0f);
+		group.held = (start_pause == 0.0f && group.pause_gain == 0.0f);
+
+		group.start_gain = group.volume.value * start_pause;
+		step_value_ramp(group.volume);
+		group.end_gain = group.volume.value * group.pause_gain;
+	}
 
-			step_value_ramp(playing_sample.pan);
+	//stop voices belonging to groups stopped since they started:
+	if (mix_groups_stopped) {
+		for (uint32_t v : voices.active) {
+			MixGroup const &group = mix_groups[voices.group[v]];
+			if (voices.group_stop_serial[v] != group.stop_serial) {
+				stop_voice(v, group.stop_ramp);
+			}
 		}
-		start_pan.l *= start_volume * playing_sample.volume.value;
-		start_pan.r *= start_volume * playing_sample.volume.value;
+		mix_groups_stopped = false;
+	}
 
-		step_value_ramp(playing_sample.volume);
+	//pick the voices that will actually be mixed this block:
+	choose_real_voices(start_position, std::max(start_volume, end_volume));
+
+	//compute panning/volume at the start and end of the mix period for each active voice.
+	// The voices being mixed are gathered into arrays (3D voices first), so their gains can be
+	// computed all at once by the panning kernels:
+	voices.panned_3D.clear();
+	voices.panned_2D.clear();
+	for (uint32_t v : voices.active) {
+		if (voice_held(v)) continue; //(paused: ramps stay where they are)
+
+		bool real = (voices.flags[v] & VoicePool::Real) != 0;
+		bool was_real = was_real_last_block(v);
+
+		if (!real && !was_real) {
+			//virtual voice: keep its ramps moving, but skip the panning math:
+			if (voices.flags[v] & VoicePool::Is3D) {
+				step_position_ramp(voices.position[v]);
+				step_value_ramp(voices.half_volume_radius[v]);
+			} else {
+				step_value_ramp(voices.pan[v]);
+			}
+			step_value_ramp(voices.volume[v]);
+			step_value_ramp(voices.reverb_send[v]);
+			continue;
+		}
+
+		if (voices.flags[v] & VoicePool::Is3D) voices.panned_3D.emplace_back(v);
+		else voices.panned_2D.emplace_back(v);
+	}
+
+	//entry i holds the start of the block for the i'th panned voice, entry (panned + i) the end:
+	uint32_t const panned_3D = uint32_t(voices.panned_3D.size());
+	uint32_t const panned = panned_3D + uint32_t(voices.panned_2D.size());
+	auto panned_voice = [](uint32_t i) {
+		return (i < voices.panned_3D.size() ? voices.panned_3D[i] : voices.panned_2D[i - voices.panned_3D.size()]);
+	};
 
-		//..and end of the mix period:
-		LR end_pan;
-		if (!(playing_sample.pan.value == playing_sample.pan.value)) {
-			//3D panning
-			compute_pan_from_listener_and_position(
-				end_position, end_right,
-				playing_sample.position.value,
-				playing_sample.half_volume_radius.value,
-				&end_pan.l, &end_pan.r);
+	for (uint32_t i = 0; i < panned; ++i) {
+		uint32_t v = panned_voice(i);
+		uint32_t s = i, e = panned + i;
+
+		//voices becoming real fade in, voices becoming virtual fade out (over one block):
+		voices.pan_gain[s] = (was_real_last_block(v) ? start_volume * voices.volume[v].value : 0.0f);
+		step_value_ramp(voices.volume[v]);
+		voices.pan_gain[e] = (voices.flags[v] & VoicePool::Real ? end_volume * voices.volume[v].value : 0.0f);
+
+		//group volume (and pause fade):
+		MixGroup const &group = mix_groups[voices.group[v]];
+		voices.pan_gain[s] *= group.start_gain;
+		voices.pan_gain[e] *= group.end_gain;
+
+		if (i < panned_3D) {
+			voices.pan_x[s] = voices.position[v].value.x;
+			voices.pan_y[s] = voices.position[v].value.y;
+			voices.pan_z[s] = voices.position[v].value.z;
+			voices.pan_half_radius[s] = voices.half_volume_radius[v].value;
+			step_position_ramp(voices.position[v]);
+			step_value_ramp(voices.half_volume_radius[v]);
+			voices.pan_x[e] = voices.position[v].value.x;
+			voices.pan_y[e] = voices.position[v].value.y;
+			voices.pan_z[e] = voices.position[v].value.z;
+			voices.pan_half_radius[e] = voices.half_volume_radius[v].value;
 		} else {
-			//2D panning
-			compute_pan_weights(playing_sample.pan.value, &end_pan.l, &end_pan.r);
+			voices.pan_amount[s] = voices.pan[v].value;
+			step_value_ramp(voices.pan[v]);
+			voices.pan_amount[e] = voices.pan[v].value;
 		}
+	}
 
-		end_pan.l *= end_volume * playing_sample.volume.value;
-		end_pan.r *= end_volume * playing_sample.volume.value;
+	//3D voices: direction and distance attenuation, relative to the listener at the start and end of the block:
+	for (uint32_t first : {0u, panned}) {
+		glm::vec3 const &position = (first == 0 ? start_position : end_position);
+		glm::vec3 const &right = (first == 0 ? start_right : end_right);
+		pan_from_3D(&position.x, &right.x,
+			voices.pan_x.data() + first, voices.pan_y.data() + first, voices.pan_z.data() + first, voices.pan_half_radius.data() + first,
+			panned_3D,
+			voices.pan_amount.data() + first, voices.pan_gain.data() + first);
+	}
 
-		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
-		LR pan_step;
-		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
-		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
+	//every voice: equal-power panning:
+	pan_gains(voices.pan_amount.data(), voices.pan_gain.data(), 2 * panned, voices.pan_left.data(), voices.pan_right.data());
 
-		assert(playing_sample.i < playing_sample.data.size());
+	for (uint32_t i = 0; i < panned; ++i) {
+		uint32_t v = panned_voice(i);
+		voices.start_gain[v] = LR{voices.pan_left[i], voices.pan_right[i]};
+		voices.end_gain[v] = LR{voices.pan_left[panned + i], voices.pan_right[panned + i]};
 
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+		//(sends use the gain before panning, so a sample's reverb doesn't depend on where it is panned)
+		voices.start_send[v] = voices.pan_gain[i] * voices.reverb_send[v].value;
+		step_value_ramp(voices.reverb_send[v]);
+		voices.end_send[v] = voices.pan_gain[panned + i] * voices.reverb_send[v].value;
+	}
 
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
+	//add audio from each active voice into the buffer:
+	uint32_t still_active = 0;
+	for (uint32_t v : voices.active) {
+		//voices started with play_at may begin partway through (or after) this block:
+		uint64_t start_offset = (voices.start_time[v] > mix_time ? voices.start_time[v] - mix_time : 0);
+		bool waiting = (start_offset >= mix_samples) || voice_held(v); //(held voices wait for their group to resume)
+		uint32_t offset = (waiting ? mix_samples : uint32_t(start_offset));
+
+		bool real = (voices.flags[v] & VoicePool::Real) != 0;
+		bool mix = (real || was_real_last_block(v)); //(voices becoming virtual are mixed for one more block, to fade out)
+
+		//figure out a step to add at each sample so that pan will move smoothly from start to end:
+		LR pan = voices.start_gain[v];
+		LR pan_step;
+		pan_step.l = (voices.end_gain[v].l - pan.l) / float(mix_samples);
+		pan_step.r = (voices.end_gain[v].r - pan.r) / float(mix_samples);
+
+		bool finished = false;
+		if (waiting) {
+			//nothing to play yet
+		} else if (ModalSynth::Note const *note = voices.note[v]) {
+			//synthesized note: run the oscillator bank (or, if virtual, just step its phasors):
+			float *partial_re = &voices.partial_re[v * ModalSynth::MaxPartials];
+			float *partial_im = &voices.partial_im[v * ModalSynth::MaxPartials];
+			if (mix) {
+				std::fill(decoded_data, decoded_data + (mix_samples - offset), 0.0f);
+				oscillator_bank(partial_re, partial_im, note->w_re, note->w_im, note->partials, decoded_data, mix_samples - offset);
+				mix_voice_run(v, decoded_data, mix_samples - offset, offset, pan, pan_step, buffer);
+			} else {
+				ModalSynth::advance(*note, partial_re, partial_im, mix_samples - offset);
+			}
+			//(done once it has died away to about -90dB)
+			finished = (ModalSynth::settle(*note, partial_re, partial_im) < 1e-9f);
+		} else if (OpusStream *stream = voices.stream[v]) {
+			//streamed voice: take the next block from the decoder thread (even if virtual, so playback keeps advancing):
+			uint32_t count = stream->read(decoded_data, mix_samples - offset, offline); //(offline rendering waits for the decoder, so output doesn't depend on timing)
+			if (mix) {
+				mix_voice_run(v, decoded_data, count, offset, pan, pan_step, buffer);
+			}
+			finished = (count < mix_samples - offset && stream->ended());
+		} else if (voices.rate[v].value != 1.0f || voices.phase[v] != 0.0f) {
+			//sample voice playing at another rate:
+			finished = mix_resampled(v, offset, mix, pan, pan_step, buffer);
+			step_value_ramp(voices.rate[v]);
+		} else {
+			void const *data = voices.data[v];
+			Sound::Sample::Format format = voices.format[v];
+			uint32_t const data_size = voices.size[v];
+			uint32_t cursor = voices.cursor[v];
+			assert(cursor < data_size);
+
+			if (mix) {
+				//mix in contiguous runs of sample data, splitting only where playback hits the end of the data:
+				for (uint32_t mixed = offset; mixed < mix_samples; /* later */) {
+					uint32_t run = std::min(mix_samples - mixed, data_size - cursor);
+					if (format == Sound::Sample::S16) {
+						//(converted to floating point by the kernel)
+						mix_voice_run(v, static_cast< int16_t const * >(data) + cursor, run, mixed, pan, pan_step, buffer);
+					} else if (format == Sound::Sample::ADPCM) {
+						//(decoded a run at a time)
+						decode_adpcm(static_cast< uint8_t const * >(data), cursor, run, decoded_data);
+						mix_voice_run(v, decoded_data, run, mixed, pan, pan_step, buffer);
+					} else {
+						mix_voice_run(v, static_cast< float const * >(data) + cursor, run, mixed, pan, pan_step, buffer);
+					}
+					mixed += run;
+
+					//update position in sample:
+					cursor += run;
+					if (cursor == data_size) {
+						if (voices.flags[v] & VoicePool::Loop) {
+							cursor = voices.loop_start[v];
+						} else {
+							break;
+						}
+					}
+				}
+			} else {
+				//virtual voice: advance position in sample as if it had been mixed:
+				if (voices.flags[v] & VoicePool::Loop) {
+					uint64_t next = uint64_t(cursor) + (mix_samples - offset);
+					if (next >= data_size) {
+						uint32_t loop_start = voices.loop_start[v];
+						next = loop_start + (next - loop_start) % (data_size - loop_start);
+					}
+					cursor = uint32_t(next);
 				} else {
-					break;
+					cursor = uint32_t(std::min< uint64_t >(uint64_t(cursor) + (mix_samples - offset), data_size));
 				}
 			}
+			voices.cursor[v] = cursor;
+			finished = (cursor >= data_size);
+			step_value_ramp(voices.rate[v]);
+		}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+		//remember whether voice was mixed, to fade it in/out when that changes:
+		if (!waiting) {
+			voices.flags[v] &= uint8_t(~VoicePool::Fresh);
+			if (real) voices.flags[v] &= uint8_t(~VoicePool::Virtual);
+			else voices.flags[v] |= VoicePool::Virtual;
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
-		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+		if (finished
+		 || ((voices.flags[v] & VoicePool::Stopping) && voices.volume[v].value == 0.0f)) { //voice has finished
+			//invalidate handles, then give the slot back to the game thread:
+			voices.generation[v].fetch_add(1, std::memory_order_release);
+			bool pushed = free_voices.push(v);
+			assert(pushed && "free list has room for every voice"); (void)pushed;
 		} else {
-			++si;
+			voices.active[still_active++] = v;
+		}
+	}
+	uint32_t active_voices = uint32_t(voices.active.size()); //(voices mixed this block, including any that just finished)
+	voices.active.resize(still_active);
+
+	//reverb bus: convolve the sends (a reverb block at a time) and add the result to the output:
+	if (mix_reverb) {
+		float start_return = mix_reverb_volume.value;
+		step_value_ramp(mix_reverb_volume);
+		float return_step = (mix_reverb_volume.value - start_return) / float(mix_samples);
+
+		uint32_t const reverb_block = mix_reverb->block; //(set_reverb checked that this divides mix_samples)
+		for (uint32_t s = 0; s < mix_samples; ++s) {
+			reverb_mono[s] = reverb_input[s].l;
+		}
+		for (uint32_t first = 0; first < mix_samples; first += reverb_block) {
+			mix_reverb->process(reverb_mono + first, &reverb_output[first].l);
+		}
+		for (uint32_t s = 0; s < mix_samples; ++s) {
+			float gain = start_return + float(s) * return_step;
+			buffer[s].l += gain * reverb_output[s].l;
+			buffer[s].r += gain * reverb_output[s].r;
 		}
 	}
 
+	//hand a copy of the finished block to the spectrum analyzer (if any):
+	if (mix_analyzer) mix_analyzer->tap(&buffer[0].l, mix_samples);
+
+	mix_time += mix_samples;
+
+	record_block_stats(block_start, active_voices);
+
 	/*//DEBUG: report output power:
 	float max_power = 0.0f;
-	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
+	for (uint32_t s = 0; s < mix_samples; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; active voices: " << voices.active.size() << std::endl; //DEBUG
 	*/
 
 }
-
-
@@ -6,23 +6,113 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <cstdint>
 
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
 
+struct OpusStream; //(defined in OpusStream.hpp)
+struct ConvolutionReverb; //(defined in ConvolutionReverb.hpp)
+struct ModalSynth; //(defined in ModalSynth.hpp)
+
 namespace Sound {
 
 //Sample objects hold mono (one-channel) audio.
 struct Sample {
+	//Sample data may be kept in a compact format to save memory;
+	// the mixer converts it to floating point as it plays, so no full-size copy is ever made.
+	enum Format : uint8_t {
+		F32, //32-bit floating point
+		S16, //16-bit integer -- half the memory; lossless for 16-bit source files
+		ADPCM, //4-bit IMA ADPCM (see adpcm.hpp) -- about an eighth of the memory; lossy, so best for sound effects
+	};
+
 	//Load from a '.wav' or '.opus' file.
 	//  will warn and convert if sound is not already 48kHz mono:
-	Sample(std::string const &filename);
+	Sample(std::string const &filename, Format format = F32);
 	
 	//Directly supply an audio buffer:
-	Sample(std::vector< float > const &data);
+	Sample(std::vector< float > const &data, Format format = F32);
+	Sample(std::vector< float > &&data, Format format = F32);
+
+	//sample data is stored as 48kHz, mono, in one of these (according to 'format'):
+	Format format = F32;
+	std::vector< float > data; //F32
+	std::vector< int16_t > data_s16; //S16
+	std::vector< uint8_t > data_adpcm; //ADPCM
+	uint32_t adpcm_frames = 0; //(length of ADPCM data, since blocks are padded)
+
+	//length in frames (whatever the format):
+	uint32_t frames() const;
+	//memory used by sample data:
+	size_t bytes() const;
+};
+
+//Load a bank of samples (e.g., one per piano key) at once, decoding the files in parallel.
+// Returned in the same order as 'filenames'; prints the time each file took to decode.
+// (throws if any file fails to load)
+std::vector< Sample > load_samples(std::vector< std::string > const &filenames, Sample::Format format = Sample::F32);
+
+//Slice objects name a region of a Sample, so it can be played without copying its data
+// (e.g., one sound from a bank packed into a single long recording).
+// Playing a slice plays frames [start, end); looping it plays from 'start' to 'loop_end',
+// then repeats [loop_start, loop_end) -- so a slice can have an intro before its loop.
+// (a Slice is a small non-owning view; like any Sample, its sample must outlive playback)
+struct Slice {
+	//frames [start, end) of 'sample' (end == -1U means the end of the sample), looping over the whole region:
+	Slice(Sample const &sample, uint32_t start = 0, uint32_t end = -1U);
+	//...with a loop region inside it (throws unless start <= loop_start < loop_end <= end):
+	Slice(Sample const &sample, uint32_t start, uint32_t end, uint32_t loop_start, uint32_t loop_end);
+
+	Sample const *sample;
+	uint32_t start, end;
+	uint32_t loop_start, loop_end;
+};
+
+//Stream objects play long audio (music, ambience) straight from an '.opus' file,
+// decoding a little at a time on a background thread instead of loading it all up front.
+//NOTE: a stream has only one playback position, so play it through at most one PlayingSample at a time.
+// (destroying a Stream cuts off its playback; it waits -- a block or so -- for the mixer to stop reading it)
+struct Stream {
+	Stream(std::string const &filename);
+	~Stream();
+
+	//jump playback to 'seconds' from the start of the file:
+	void seek(float seconds);
+
+	//internals:
+	std::unique_ptr< OpusStream > source;
+	bool played = false; //has this stream been played before? (if so, playing it again seeks to the start)
+};
+
+//Reverb objects hold a (room) impulse response, prepared for the mixer's reverb bus:
+// playing samples send some of their sound to the bus (see PlayingSample::set_reverb_send), and
+// the bus is convolved with the impulse response and mixed back in (see Sound::set_reverb).
+//NOTE: the impulse response is partitioned to match the mixer's block size, so make Reverbs after Sound::init().
+// (destroying the Reverb in use turns the bus off; it waits -- a block or so -- for the mixer to stop using it)
+struct Reverb {
+	//Load an impulse response from a '.wav' or '.opus' file (used for both ears), or one file per ear:
+	Reverb(std::string const &filename);
+	Reverb(std::string const &left_filename, std::string const &right_filename);
 
-	//sample data is stored as 48kHz, mono, floating-point:
-	std::vector< float > data;
+	//Directly supply impulse responses (48kHz; if 'right' is empty, 'left' is used for both ears):
+	Reverb(std::vector< float > const &left, std::vector< float > const &right = std::vector< float >());
+	~Reverb();
+
+	//internals:
+	std::unique_ptr< ConvolutionReverb > convolver; //(its state belongs to the audio thread while in use)
+};
+
+//Instrument objects synthesize notes as they play, instead of playing recorded sample data:
+// each note is a bank of decaying partials, modeled on a piano string (see ModalSynth.hpp),
+// so any MIDI note can be played, with no sample memory and nothing to load.
+// (destroying an Instrument cuts off any notes still playing on it; like a Reverb, it waits for the mixer to let go)
+struct Instrument {
+	Instrument(); //a piano
+	~Instrument();
+
+	//internals:
+	std::unique_ptr< ModalSynth > synth;
 };
 
 //Ramp<> manages values that should be smoothly interpolated
@@ -48,9 +138,16 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+//Groups ("buses") control whole categories of samples at once (e.g., music vs. interface sounds):
+// every sample plays in a group -- the default group, unless another is passed to play() and friends.
+// See create_group() and the *_group() functions below.
+struct Group {
+	uint8_t index = 0; //(0 is the default group)
+};
+
+// 'PlayingSample' objects are handles to samples that are currently playing:
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
@@ -59,53 +156,100 @@ struct PlayingSample {
 	void set_position(glm::vec3 const &new_position, float ramp = 1.0f / 60.0f);
 	//set the half-volume radius (use only on "3D" playing sounds):
 	void set_half_volume_radius(float new_radius, float ramp = 1.0f / 60.0f);
+	//set the playback rate (2.0f == twice as fast, so an octave up; clamped to [1/16, 4]):
+	// (only affects samples, not streams or notes)
+	void set_rate(float new_rate, float ramp = 1.0f / 60.0f);
+
+	//set how much of the sample goes to the reverb bus (0 = none, the default; 1 = as loud as the sample itself):
+	// (the send follows the sample's volume and distance attenuation, but not its panning)
+	void set_reverb_send(float new_send, float ramp = 1.0f / 60.0f);
+
+	//when more samples are audible than Sound::set_voice_limits() allows, higher-priority samples are mixed first:
+	// (default priority is 0; ties are broken by loudness)
+	void set_priority(float new_priority);
 
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
 	void stop(float ramp = 1.0f / 60.0f);
 
+	//was playback stopped (either by running out of sample, or by stop())?
+	bool stopped() const;
+
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	//NOTE: playback state lives in the audio thread's voice pool (see Sound.cpp);
+	// the functions above queue commands that the audio thread applies at the start of its next mix block.
+	// A handle names a pool slot plus that slot's generation, which is bumped whenever the slot
+	// is freed -- so handles to finished samples are harmless, even after the slot is reused.
+	uint32_t voice = -1U; //slot in voice pool (-1U if no slot was available)
+	uint32_t generation = 0; //generation of slot when playback started
+	bool is_3D = false; //was sample played in "3D" mode?
+
+	PlayingSample(uint32_t voice_, uint32_t generation_, bool is_3D_) : voice(voice_), generation(generation_), is_3D(is_3D_) { }
 };
 
 // ------- global functions -------
 
-void init(); //call Sound::init() from main.cpp before using any member functions
+//call Sound::init() from main.cpp before using any member functions:
+// at most 'voice_capacity' samples can play at once; storage for them is allocated here, up front.
+// 'block_size' is the number of frames mixed at once (a power of two, 128 to 1024); smaller blocks mean
+//  less delay between a play() call and hearing it (1024 frames is ~21ms), but more mixing overhead.
+// if 'lookahead_blocks' is nonzero, mixing happens on a separate thread, that many blocks ahead
+//  of the device: a slow block then no longer causes a dropout, but every change takes that much longer to be heard.
+void init(uint32_t voice_capacity = 256, uint32_t lookahead_blocks = 0, uint32_t block_size = 1024);
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//Offline rendering -- for benchmarks, tests, and bouncing audio to disk:
+// init_offline() sets up the mixer without opening an audio device (use instead of init());
+// render() then runs the mixer directly, producing 'frames' frames of 48kHz stereo (LRLR...) into 'out'.
+// Output depends only on the calls made (not on timing), so it is the same every run.
+void init_offline(uint32_t voice_capacity = 256, uint32_t block_size = 1024);
+void render(float *out, uint32_t frames);
+
+//block size in use (frames), and the worst-case delay (in milliseconds) from a play() call to its audio
+// leaving the mixer, as obtained from the device (0 if there is no device). The device's own buffering comes on top:
+uint32_t block_size();
+float latency_ms();
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
 std::shared_ptr< PlayingSample > play(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Group group = Group()
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
 std::shared_ptr< PlayingSample > play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Group group = Group()
+);
+
+//The mixer's clock: the sample (48kHz frame) at which the next mix block will start.
+uint64_t sample_time();
+
+//Call 'Sound::play_at' to start a sample on exactly frame 'start_time' (see 'sample_time()'),
+// rather than at the start of whatever mix block comes next.
+// If the mixer only gets the request after 'start_time', playback skips ahead to stay in step.
+//  'rate' is the initial playback rate (see PlayingSample::set_rate).
+std::shared_ptr< PlayingSample > play_at(
+	uint64_t start_time,
+	Sample const &sample,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	float rate = 1.0f,
+	Group group = Group()
+);
+
+//Call 'Sound::play_many' to start several samples on the same frame (e.g., the notes of a chord).
+//  returns one handle per sample, in the same order:
+std::vector< std::shared_ptr< PlayingSample > > play_many(
+	std::vector< Sample const * > const &samples,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	Group group = Group()
 );
 
 //Call 'Sound::loop' to play a sample ~forever~.
@@ -113,21 +257,60 @@ std::shared_ptr< PlayingSample > play_3D(
 std::shared_ptr< PlayingSample > loop(
 	Sample const &sample,
 	float volume = 1.0f,
-	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+	float pan = 0.0f, //-1.0f == hard left, 1.0f == hard right
+	Group group = Group()
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
 std::shared_ptr< PlayingSample > loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
-	float half_volume_radius = std::numeric_limits< float >::infinity()
+	float half_volume_radius = std::numeric_limits< float >::infinity(),
+	Group group = Group()
 );
 
+//Call 'Sound::play_note' to play MIDI note 'note' (60 is middle C) on an instrument:
+//  'velocity' (0 - 1) is how hard the note is struck -- harder notes are louder and brighter.
+//  the note rings until it dies away; stop() it (with a short ramp) to model letting go of the key.
+std::shared_ptr< PlayingSample > play_note(
+	Instrument const &instrument,
+	uint8_t note,
+	float velocity = 1.0f,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	Group group = Group()
+);
+
+//Call 'Sound::play_notes' to start several notes on the same frame (e.g., a chord):
+//  returns one handle per note, in the same order:
+std::vector< std::shared_ptr< PlayingSample > > play_notes(
+	Instrument const &instrument,
+	std::vector< uint8_t > const &notes,
+	float velocity = 1.0f,
+	float volume = 1.0f,
+	float pan = 0.0f,
+	Group group = Group()
+);
+
+//Slices can be played in all the same ways as samples:
+std::shared_ptr< PlayingSample > play(Slice const &slice, float volume = 1.0f, float pan = 0.0f, Group group = Group());
+std::shared_ptr< PlayingSample > play_3D(Slice const &slice, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity(), Group group = Group());
+std::shared_ptr< PlayingSample > play_at(uint64_t start_time, Slice const &slice, float volume = 1.0f, float pan = 0.0f, float rate = 1.0f, Group group = Group());
+std::shared_ptr< PlayingSample > loop(Slice const &slice, float volume = 1.0f, float pan = 0.0f, Group group = Group());
+std::shared_ptr< PlayingSample > loop_3D(Slice const &slice, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity(), Group group = Group());
+
+//Streams can be played in all the same ways as samples:
+std::shared_ptr< PlayingSample > play(Stream &stream, float volume = 1.0f, float pan = 0.0f, Group group = Group());
+std::shared_ptr< PlayingSample > play_3D(Stream &stream, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity(), Group group = Group());
+std::shared_ptr< PlayingSample > loop(Stream &stream, float volume = 1.0f, float pan = 0.0f, Group group = Group());
+std::shared_ptr< PlayingSample > loop_3D(Stream &stream, float volume, glm::vec3 const &position, float half_volume_radius = std::numeric_limits< float >::infinity(), Group group = Group());
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
 
 	//internals:
+	//(the most recently requested values; the audio thread keeps its own copy)
 	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(0.0f); //listener's location
 	Ramp< glm::vec3 > right = Ramp< glm::vec3 >(1.0f, 0.0f, 0.0f); //unit vector pointing to listener's right
 };
@@ -136,13 +319,75 @@ extern struct Listener listener;
 //"panic button" to shut off all currently playing sounds:
 void stop_all_samples();
 
+//Group controls -- each takes the same (small) time however many samples are playing in the group:
+//make a new group (up to 15 besides the default group; throws if there are no more):
+Group create_group();
+//set group volume (multiplies the volume of every sample in the group):
+void set_group_volume(Group group, float volume, float ramp = 1.0f / 60.0f);
+//pause/resume every sample in the group (paused samples fade out, then stop advancing until resumed):
+void pause_group(Group group);
+void resume_group(Group group);
+//stop every sample playing in the group (samples started afterward play as usual):
+void stop_group(Group group, float ramp = 1.0f / 60.0f);
+
+//Reverb bus -- samples' sends (see PlayingSample::set_reverb_send) are convolved with 'reverb's impulse response,
+// and mixed back in at 'return_volume'. Pass nullptr to turn the reverb off (cutting off any tail).
+// The cost per block doesn't depend on how many samples send to the bus; it grows only slowly with impulse response length.
+// (throws if the reverb was made for a larger block size than the mixer's)
+void set_reverb(Reverb const *reverb, float return_volume = 1.0f);
+void set_reverb_volume(float return_volume, float ramp = 1.0f / 60.0f);
+
+//Spectrum analyzer -- measures the frequency content of the output on its own thread (for visualizers).
+// The mixer only copies each block it mixes; the transforms run elsewhere.
+//start analyzing with an 'fft_size'-point transform (a power of two; 2048 or 4096 suit most uses),
+// reduced to 'bands' logarithmically-spaced bands (replaces any analyzer already running):
+// (stopping or replacing an analyzer waits -- a block or so -- for the mixer to stop tapping it)
+void start_analyzer(uint32_t fft_size = 2048, uint32_t bands = 32);
+void stop_analyzer();
+//level of each band (lowest first), in dB relative to a full-scale sine wave, -96 at the quietest:
+// (empty if no analyzer is running)
+void get_spectrum(std::vector< float > *levels);
+
+//Voice limiting: only the 'max_real_voices' most important audible samples are actually mixed.
+// The rest are "virtual" -- their playback keeps advancing, but nothing is mixed -- and they
+// fade back in when they become important/audible again.
+// A sample is inaudible when its volume (including distance attenuation) is below 'audibility_threshold'.
+void set_voice_limits(uint32_t max_real_voices, float audibility_threshold = 1e-4f);
+
 //set global volume:
 void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
-extern Ramp< float > volume;
+extern Ramp< float > volume; //(the most recently requested value; the audio thread keeps its own copy)
+
+//Mixer performance statistics, for spotting audio glitches before they are heard:
+struct Stats {
+	uint64_t blocks = 0; //blocks mixed since init() or reset_stats()
+	//time taken by the mixer per block, in milliseconds:
+	float min_ms = 0.0f;
+	float avg_ms = 0.0f;
+	float p99_ms = 0.0f; //(estimated from a histogram; within about 10%)
+	float max_ms = 0.0f;
+	float deadline_ms = 0.0f; //audio length of one block -- mixing any slower than this can't keep up
+	float budget_ms = 0.0f; //see set_stats_budget()
+	uint64_t over_budget_blocks = 0; //blocks that took longer than budget_ms to mix
+	uint64_t late_blocks = 0; //blocks requested over a block late, or (with look-ahead) not mixed in time -- an audible dropout
+	uint32_t active_voices = 0; //voices playing (real or virtual) in the most recent block
+	uint32_t real_voices = 0; //voices actually mixed in the most recent block
+	uint32_t peak_active_voices = 0; //most voices playing in any block
+};
+//get a snapshot of the statistics (doesn't lock or otherwise disturb the audio thread):
+Stats get_stats();
+//start counting again from zero:
+void reset_stats();
+//count blocks that take longer than 'budget_ms' to mix (default: the block deadline):
+void set_stats_budget(float budget_ms);
 
-//the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+//the mixer (audio callback or look-ahead thread) doesn't run between Sound::lock() and Sound::unlock()
+// the set_*/stop/play/... functions don't need these (they send commands to the audio thread
+// through a lock-free queue instead), so you shouldn't need to call them unless
+// your code is modifying audio-thread values directly:
+// (the lock is recursive, and the other Sound functions may still be called while holding it: anything that would
+//  wait on the mixer -- a command queue filled by a burst of play/set_* calls, or destroying a Stream, Reverb, or Instrument,
+//  or stopping/replacing the analyzer -- applies the queued commands on the locking thread instead)
 void lock();
 void unlock();
 
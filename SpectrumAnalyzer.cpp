@@ -0,0 +1,123 @@
+#include "SpectrumAnalyzer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+static constexpr float const AUDIO_RATE = 48000.0f;
+
+SpectrumAnalyzer::SpectrumAnalyzer(uint32_t fft_size, uint32_t bands, float min_hz, float max_hz) : fft(fft_size) {
+	hop = fft_size / 4;
+	ring.reset(2 * 4 * fft_size); //(a few transforms' worth of stereo frames)
+
+	//Hann window; its coherent gain is 1/2, and a real sine of amplitude A puts A * size / 2 in its bin, hence the 4 / size:
+	double const pi = 3.14159265358979323846;
+	window.resize(fft_size);
+	for (uint32_t i = 0; i < fft_size; ++i) {
+		window[i] = float((4.0 / double(fft_size)) * 0.5 * (1.0 - std::cos(2.0 * pi * double(i) / double(fft_size))));
+	}
+
+	history.assign(fft_size, 0.0f);
+	stereo.resize(2 * fft_size);
+	windowed.resize(fft_size);
+	re.resize(fft.bins());
+	im.resize(fft.bins());
+
+	//band edges, logarithmically spaced, each at least one bin wide:
+	band_bins.resize(bands + 1);
+	float bin_hz = AUDIO_RATE / float(fft_size);
+	uint32_t last_bin = fft.bins() - 1;
+	for (uint32_t b = 0; b <= bands; ++b) {
+		float hz = min_hz * std::pow(max_hz / min_hz, float(b) / float(bands));
+		band_bins[b] = std::min(last_bin, uint32_t(std::lround(hz / bin_hz)));
+		if (b > 0) band_bins[b] = std::max(band_bins[b], band_bins[b-1] + 1);
+	}
+	band_bins[bands] = std::min(band_bins[bands], last_bin + 1);
+
+	analyzed.assign(bands, FloorDB);
+	levels.assign(bands, FloorDB);
+
+	thread = std::thread(&SpectrumAnalyzer::analyzer_thread, this);
+}
+
+SpectrumAnalyzer::~SpectrumAnalyzer() {
+	{
+		std::lock_guard< std::mutex > lock(wake_mutex);
+		quit = true;
+	}
+	wake_cv.notify_one();
+	thread.join();
+}
+
+void SpectrumAnalyzer::tap(float const *stereo_, uint32_t frames) {
+	ring.push_many(stereo_, 2 * frames);
+}
+
+void SpectrumAnalyzer::get_bands(std::vector< float > *levels_) {
+	assert(levels_);
+	std::lock_guard< std::mutex > lock(levels_mutex);
+	*levels_ = levels;
+}
+
+void SpectrumAnalyzer::analyze() {
+	for (uint32_t i = 0; i < fft.size; ++i) {
+		windowed[i] = history[i] * window[i];
+	}
+	fft.forward(windowed.data(), re.data(), im.data());
+
+	//each band's level is that of its loudest bin:
+	for (uint32_t b = 0; b + 1 < band_bins.size(); ++b) {
+		float peak = 0.0f;
+		for (uint32_t k = band_bins[b]; k < band_bins[b+1]; ++k) {
+			peak = std::max(peak, re[k] * re[k] + im[k] * im[k]);
+		}
+		analyzed[b] = std::max(FloorDB, 10.0f * std::log10(std::max(peak, 1e-20f)));
+	}
+}
+
+void SpectrumAnalyzer::analyzer_thread() {
+	float const hop_seconds = float(hop) / AUDIO_RATE;
+	auto last_publish = std::chrono::steady_clock::now();
+
+	std::unique_lock< std::mutex > lock(wake_mutex);
+	while (!quit) {
+		//check for new audio twice per hop:
+		wake_cv.wait_for(lock, std::chrono::duration< float >(0.5f * hop_seconds));
+		if (quit) break;
+		lock.unlock();
+
+		bool updated = false;
+		uint32_t got;
+		while ((got = ring.pop_many(stereo.data(), uint32_t(stereo.size()))) > 0) {
+			//(the ring is filled a whole block at a time, so 'got' is always even)
+			uint32_t frames = got / 2;
+			for (uint32_t f = 0; f < frames; /* later */) {
+				uint32_t run = std::min(frames - f, hop - fresh);
+				std::copy(history.begin() + run, history.end(), history.begin());
+				for (uint32_t i = 0; i < run; ++i) {
+					history[fft.size - run + i] = 0.5f * (stereo[2 * (f + i)] + stereo[2 * (f + i) + 1]);
+				}
+				f += run;
+				fresh += run;
+				if (fresh == hop) {
+					analyze();
+					fresh = 0;
+					updated = true;
+				}
+			}
+		}
+
+		if (updated) {
+			auto now = std::chrono::steady_clock::now();
+			float elapsed = std::chrono::duration< float >(now - last_publish).count();
+			last_publish = now;
+			std::lock_guard< std::mutex > levels_lock(levels_mutex);
+			for (uint32_t b = 0; b < levels.size(); ++b) {
+				levels[b] = std::max(analyzed[b], std::max(FloorDB, levels[b] - FallRate * elapsed));
+			}
+		}
+
+		lock.lock();
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+ * SpectrumAnalyzer measures the frequency content of the mix as it plays (for visualizers).
+ *
+ * The audio thread only copies each mixed block into a RingBuffer (tap());
+ *  everything else happens on the analyzer's own thread, which downmixes to mono,
+ *  takes a Hann-windowed RealFFT of the most recent 'fft_size' frames every fft_size/4 frames,
+ *  and reduces the spectrum to 'bands' logarithmically-spaced bands.
+ * The game thread reads the most recent band levels with get_bands().
+ *
+ */
+
+#include "RealFFT.hpp"
+#include "RingBuffer.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct SpectrumAnalyzer {
+	//'fft_size' is a power of two (2048 or 4096 are good choices; throws otherwise);
+	// bands are spaced logarithmically from 'min_hz' to 'max_hz'. Starts the analyzer thread:
+	SpectrumAnalyzer(uint32_t fft_size = 2048, uint32_t bands = 32, float min_hz = 40.0f, float max_hz = 16000.0f);
+	~SpectrumAnalyzer();
+
+	//------ audio thread ------
+
+	//copy 'frames' frames of stereo (LRLR...) audio for analysis:
+	// (never blocks; if the analyzer thread has fallen behind, the frames are dropped)
+	void tap(float const *stereo, uint32_t frames);
+
+	//------ game thread ------
+
+	//level of each band (lowest first), in dB relative to a full-scale sine wave:
+	// (levels jump up at once but fall at 'FallRate' dB per second, so short notes stay visible)
+	void get_bands(std::vector< float > *levels);
+
+	//------ internals ------
+	static constexpr float const FloorDB = -96.0f; //(quietest level reported)
+	static constexpr float const FallRate = 48.0f;
+
+	RingBuffer< float > ring; //(audio thread -> analyzer thread) interleaved stereo
+
+	//analyzer thread state:
+	RealFFT fft;
+	uint32_t hop; //frames between transforms
+	std::vector< float > window; //Hann window, scaled so a full-scale sine peaks at 1.0
+	std::vector< float > history; //most recent fft_size frames (mono)
+	uint32_t fresh = 0; //frames added to history since the last transform
+	std::vector< float > stereo; //(scratch) frames popped from ring
+	std::vector< float > windowed, re, im; //(scratch) transform input and output
+	std::vector< uint32_t > band_bins; //band b covers bins [band_bins[b], band_bins[b+1])
+	std::vector< float > analyzed; //band levels from the most recent transform
+
+	void analyze();
+	void analyzer_thread();
+
+	std::mutex levels_mutex;
+	std::vector< float > levels; //(protected by levels_mutex) published band levels
+
+	std::thread thread;
+	std::mutex wake_mutex;
+	std::condition_variable wake_cv;
+	bool quit = false; //protected by wake_mutex
+};
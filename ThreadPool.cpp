@@ -0,0 +1,134 @@
+#include "ThreadPool.hpp"
+
+#include <cassert>
+
+ThreadPool::ThreadPool(uint32_t worker_count) {
+	if (worker_count == 0) {
+		uint32_t hardware = std::thread::hardware_concurrency();
+		worker_count = (hardware > 1 ? hardware - 1 : 1);
+	}
+	shares.reset(new Share[worker_count + 1]);
+	workers.reserve(worker_count);
+	for (uint32_t i = 0; i < worker_count; ++i) {
+		workers.emplace_back(&ThreadPool::worker_main, this, i + 1);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake_workers.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+ThreadPool &ThreadPool::get_shared() {
+	static ThreadPool shared;
+	return shared;
+}
+
+void ThreadPool::parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn) {
+	if (count == 0) return;
+
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		assert(batch_fn == nullptr && "only one parallel_for at a time");
+		batch_fn = &fn;
+		batch_serial += 1;
+		busy_workers = uint32_t(workers.size());
+		exception = nullptr;
+		//split items evenly into contiguous shares:
+		// (n.b. workers see these once they lock the mutex to notice the new batch)
+		uint32_t threads = thread_count();
+		for (uint32_t t = 0; t < threads; ++t) {
+			uint64_t begin = uint64_t(count) * t / threads;
+			uint64_t end = uint64_t(count) * (t + 1) / threads;
+			shares[t].range.store((end << 32) | begin, std::memory_order_relaxed);
+		}
+	}
+	wake_workers.notify_all();
+
+	//help out:
+	work_on_batch(0);
+
+	//wait for the workers to finish their items:
+	std::exception_ptr thrown;
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		batch_done.wait(lock, [this](){ return busy_workers == 0; });
+		batch_fn = nullptr;
+		thrown = exception;
+		exception = nullptr;
+	}
+	if (thrown) std::rethrow_exception(thrown);
+}
+
+bool ThreadPool::claim(uint32_t thread, uint32_t *item) {
+	assert(item);
+
+	{ //take the first item of this thread's own share:
+		std::atomic< uint64_t > &range = shares[thread].range;
+		uint64_t share = range.load(std::memory_order_relaxed);
+		while (uint32_t(share) < uint32_t(share >> 32)) {
+			if (range.compare_exchange_weak(share, share + 1, std::memory_order_relaxed)) {
+				*item = uint32_t(share);
+				return true;
+			}
+		}
+	}
+
+	//share is empty, so steal from the others (starting with the next thread, so thieves spread out):
+	uint32_t threads = thread_count();
+	for (uint32_t offset = 1; offset < threads; ++offset) {
+		std::atomic< uint64_t > &range = shares[(thread + offset) % threads].range;
+		uint64_t share = range.load(std::memory_order_relaxed);
+		while (uint32_t(share) < uint32_t(share >> 32)) {
+			uint32_t begin = uint32_t(share);
+			uint32_t end = uint32_t(share >> 32);
+			uint32_t middle = begin + (end - begin) / 2; //victim keeps [begin, middle), thief takes [middle, end)
+			if (range.compare_exchange_weak(share, (uint64_t(middle) << 32) | begin, std::memory_order_relaxed)) {
+				//run the first stolen item now and keep the rest as this thread's share:
+				// (n.b. other thieves leave an empty share alone, so a plain store is safe)
+				*item = middle;
+				shares[thread].range.store((uint64_t(end) << 32) | (middle + 1), std::memory_order_relaxed);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::work_on_batch(uint32_t thread) {
+	//n.b. batch_fn doesn't change until every worker has reported done:
+	std::function< void(uint32_t) > const &fn = *batch_fn;
+	uint32_t i;
+	while (claim(thread, &i)) {
+		try {
+			fn(i);
+		} catch (...) {
+			std::lock_guard< std::mutex > lock(mutex);
+			if (!exception) exception = std::current_exception();
+		}
+	}
+}
+
+void ThreadPool::worker_main(uint32_t thread) {
+	uint32_t seen_serial = 0;
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		wake_workers.wait(lock, [&](){ return quit || batch_serial != seen_serial; });
+		if (quit) break;
+		seen_serial = batch_serial;
+
+		lock.unlock();
+		work_on_batch(thread);
+		lock.lock();
+
+		busy_workers -= 1;
+		if (busy_workers == 0) batch_done.notify_one();
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+ * ThreadPool runs batches of independent work on a set of worker threads.
+ *
+ * Usage:
+ *  ThreadPool::get_shared().parallel_for(count, [&](uint32_t i){
+ *      //...do item 'i'...
+ *  });
+ *
+ * parallel_for() returns once every item is done; the calling thread helps out
+ *  while it waits. If an item throws, the first exception is rethrown from
+ *  parallel_for() (after the rest of the batch has finished).
+ *
+ * Items are handed out by work stealing: each thread starts with a contiguous
+ *  share of [0, count) and works through it front-to-back; a thread that runs out
+ *  takes the back half of another thread's remaining share. So threads mostly
+ *  touch neighbouring items (and their own counter), but a slow or late-waking
+ *  thread can't hold up the batch.
+ *
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ThreadPool {
+	//'workers' threads (in addition to the caller's); 0 means one less than the number of hardware threads:
+	ThreadPool(uint32_t workers = 0);
+	~ThreadPool();
+
+	//call fn(i) for every i in [0, count), spread across the pool:
+	// (only one parallel_for may run on a given pool at once)
+	void parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn);
+
+	//number of threads that work on a batch (workers + the caller):
+	uint32_t thread_count() const { return uint32_t(workers.size()) + 1; }
+
+	//a pool shared by everything in the program (created on first use):
+	static ThreadPool &get_shared();
+
+	//internals:
+	std::vector< std::thread > workers;
+
+	std::mutex mutex;
+	std::condition_variable wake_workers; //new batch (or quit)
+	std::condition_variable batch_done; //a worker finished its part of the batch
+	bool quit = false;
+
+	//current batch (fields are protected by mutex, except 'shares' which are claimed from atomically):
+	std::function< void(uint32_t) > const *batch_fn = nullptr;
+	uint32_t batch_serial = 0; //incremented for each batch, so workers can tell a new batch arrived
+	uint32_t busy_workers = 0; //workers still working on the current batch
+	std::exception_ptr exception; //first exception thrown by an item
+
+	//unclaimed items [begin, end) of each thread (0 is the caller, 1... are workers), packed as (end << 32) | begin:
+	struct Share {
+		std::atomic< uint64_t > range{0};
+		uint8_t padding[64 - sizeof(std::atomic< uint64_t >)]; //(each share on its own cache line)
+	};
+	std::unique_ptr< Share[] > shares;
+
+	void worker_main(uint32_t thread);
+	void work_on_batch(uint32_t thread); //claim and run items until none are left
+	bool claim(uint32_t thread, uint32_t *item); //claim an item from thread's share, or else steal some items
+};
@@ -0,0 +1,110 @@
+#include "adpcm.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+//standard IMA ADPCM tables:
+static int32_t const step_table[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static int32_t const index_table[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+//decoder state; the encoder runs a copy of the decoder so the two never drift apart:
+struct AdpcmState {
+	int32_t predictor = 0;
+	int32_t index = 0;
+
+	//apply one 4-bit code, returning the new predictor:
+	int32_t step(uint8_t nibble) {
+		int32_t step = step_table[index];
+		int32_t delta = step >> 3;
+		if (nibble & 4) delta += step;
+		if (nibble & 2) delta += step >> 1;
+		if (nibble & 1) delta += step >> 2;
+		predictor += (nibble & 8 ? -delta : delta);
+		predictor = std::max(-32768, std::min(32767, predictor));
+		index = std::max(0, std::min(88, index + index_table[nibble]));
+		return predictor;
+	}
+
+	//pick the code that best moves the predictor toward 'target':
+	uint8_t encode(int32_t target) const {
+		int32_t diff = target - predictor;
+		uint8_t nibble = 0;
+		if (diff < 0) {
+			nibble = 8;
+			diff = -diff;
+		}
+		int32_t step = step_table[index];
+		if (diff >= step) { nibble |= 4; diff -= step; }
+		step >>= 1;
+		if (diff >= step) { nibble |= 2; diff -= step; }
+		step >>= 1;
+		if (diff >= step) { nibble |= 1; }
+		return nibble;
+	}
+};
+
+void encode_adpcm(float const *src, uint32_t count, std::vector< uint8_t > *blocks_) {
+	assert(blocks_);
+	auto &blocks = *blocks_;
+
+	uint32_t block_count = (count + ADPCM_BLOCK_FRAMES - 1) / ADPCM_BLOCK_FRAMES;
+	blocks.assign(size_t(block_count) * ADPCM_BLOCK_BYTES, 0);
+
+	AdpcmState state;
+	for (uint32_t b = 0; b < block_count; ++b) {
+		uint8_t *block = blocks.data() + size_t(b) * ADPCM_BLOCK_BYTES;
+		//header:
+		uint16_t predictor = uint16_t(int16_t(state.predictor));
+		block[0] = uint8_t(predictor & 0xff);
+		block[1] = uint8_t(predictor >> 8);
+		block[2] = uint8_t(state.index);
+		block[3] = 0;
+		//codes:
+		for (uint32_t i = 0; i < ADPCM_BLOCK_FRAMES; ++i) {
+			uint32_t at = b * ADPCM_BLOCK_FRAMES + i;
+			float value = (at < count ? std::max(-1.0f, std::min(1.0f, src[at])) : 0.0f);
+			int32_t target = std::max(-32768, std::min(32767, int32_t(std::lround(value * 32768.0f))));
+			uint8_t nibble = state.encode(target);
+			state.step(nibble);
+			block[4 + i / 2] |= uint8_t(i % 2 == 0 ? nibble : nibble << 4);
+		}
+	}
+}
+
+void decode_adpcm(uint8_t const *blocks, uint32_t first, uint32_t count, float *dst) {
+	uint32_t b = first / ADPCM_BLOCK_FRAMES;
+	uint32_t i = first % ADPCM_BLOCK_FRAMES; //frame within block
+	while (count > 0) {
+		uint8_t const *block = blocks + size_t(b) * ADPCM_BLOCK_BYTES;
+		AdpcmState state;
+		state.predictor = int16_t(uint16_t(block[0] | (uint16_t(block[1]) << 8)));
+		state.index = std::min< int32_t >(88, block[2]);
+
+		//run the decoder up to the first wanted frame:
+		for (uint32_t j = 0; j < i; ++j) {
+			state.step((block[4 + j / 2] >> (4 * (j % 2))) & 0xf);
+		}
+		//...then output frames until the end of the block:
+		for (; i < ADPCM_BLOCK_FRAMES && count > 0; ++i, --count) {
+			*(dst++) = float(state.step((block[4 + i / 2] >> (4 * (i % 2))) & 0xf)) * (1.0f / 32768.0f);
+		}
+
+		b += 1;
+		i = 0;
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//IMA ADPCM (4 bits per sample) encoding of mono audio, for compact in-memory storage of sample data.
+//
+//Data is stored in independent blocks of ADPCM_BLOCK_FRAMES frames, each starting with the decoder state
+// (16-bit predictor, little-endian; step index; a zero byte) followed by two samples per byte (low nibble first).
+//Since blocks are independent, decoding can start at any block -- which is what lets the mixer play
+// (and loop, and resample) ADPCM data without ever decoding the whole sample.
+
+constexpr uint32_t const ADPCM_BLOCK_FRAMES = 64;
+constexpr uint32_t const ADPCM_BLOCK_BYTES = 4 + ADPCM_BLOCK_FRAMES / 2;
+
+//encode 'count' samples (in [-1,1]) from 'src', replacing the contents of 'blocks':
+// (the last block is padded with silence)
+void encode_adpcm(float const *src, uint32_t count, std::vector< uint8_t > *blocks);
+
+//decode frames [first, first + count) of encoded 'blocks' to 'dst':
+void decode_adpcm(uint8_t const *blocks, uint32_t first, uint32_t count, float *dst);
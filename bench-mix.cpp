@@ -0,0 +1,362 @@
+//Micro-benchmark for the audio mixer's inner loops.
+// Compares the original one-frame-at-a-time loop from mix_audio against
+// each mix_kernel variant supported by this CPU, at several voice counts
+// (with floating point and with 16-bit sample data); then times each variant's resampler at several playback rates,
+// and its panning kernels against the per-voice std::cos/std::sin panning mix_audio used before them;
+// then times the reverb bus's FFT convolution at several impulse response lengths;
+// finally, times the oscillator bank that synthesizes notes, at several note counts.
+//
+//Usage:
+//  bench-mix [blocks]
+
+#include "mix_kernel.hpp"
+#include "ConvolutionReverb.hpp"
+#include "ModalSynth.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr uint32_t const AUDIO_RATE = 48000;
+constexpr uint32_t const MIX_SAMPLES = 1024; //matches Sound.cpp
+
+struct Voice {
+	std::vector< float > const *data;
+	std::vector< int16_t > const *data_s16; //(the same data, as 16-bit values)
+	uint32_t i;
+	bool loop;
+	float start_l, start_r, end_l, end_r;
+};
+
+//the loop used by mix_audio before the kernels existed (kept here as a baseline):
+static void mix_reference(std::vector< Voice > &voices, float *buffer) {
+	for (auto &v : voices) {
+		if (v.i >= v.data->size()) continue;
+		float pan_l = v.start_l;
+		float pan_r = v.start_r;
+		float step_l = (v.end_l - v.start_l) / MIX_SAMPLES;
+		float step_r = (v.end_r - v.start_r) / MIX_SAMPLES;
+		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
+			buffer[2*i+0] += pan_l * (*v.data)[v.i];
+			buffer[2*i+1] += pan_r * (*v.data)[v.i];
+			v.i += 1;
+			if (v.i == v.data->size()) {
+				if (v.loop) {
+					v.i = 0;
+				} else {
+					break;
+				}
+			}
+			pan_l += step_l;
+			pan_r += step_r;
+		}
+	}
+}
+
+//the run-splitting loop used by mix_audio now:
+static void mix_kernel(MixMonoRampFn mix_mono_ramp, std::vector< Voice > &voices, float *buffer) {
+	for (auto &v : voices) {
+		uint32_t size = uint32_t(v.data->size());
+		if (v.i >= size) continue;
+		float step_l = (v.end_l - v.start_l) / MIX_SAMPLES;
+		float step_r = (v.end_r - v.start_r) / MIX_SAMPLES;
+		for (uint32_t mixed = 0; mixed < MIX_SAMPLES; /* later */) {
+			uint32_t run = std::min(MIX_SAMPLES - mixed, size - v.i);
+			mix_mono_ramp(v.data->data() + v.i, run, buffer + 2*mixed,
+				v.start_l + float(mixed) * step_l, v.start_r + float(mixed) * step_r,
+				step_l, step_r);
+			mixed += run;
+			v.i += run;
+			if (v.i == size) {
+				if (v.loop) v.i = 0;
+				else break;
+			}
+		}
+	}
+}
+
+//...and the same loop over 16-bit data:
+static void mix_kernel_s16(MixMonoRampS16Fn mix_mono_ramp_s16, std::vector< Voice > &voices, float *buffer) {
+	for (auto &v : voices) {
+		uint32_t size = uint32_t(v.data_s16->size());
+		if (v.i >= size) continue;
+		float step_l = (v.end_l - v.start_l) / MIX_SAMPLES;
+		float step_r = (v.end_r - v.start_r) / MIX_SAMPLES;
+		for (uint32_t mixed = 0; mixed < MIX_SAMPLES; /* later */) {
+			uint32_t run = std::min(MIX_SAMPLES - mixed, size - v.i);
+			mix_mono_ramp_s16(v.data_s16->data() + v.i, run, buffer + 2*mixed,
+				v.start_l + float(mixed) * step_l, v.start_r + float(mixed) * step_r,
+				step_l, step_r);
+			mixed += run;
+			v.i += run;
+			if (v.i == size) {
+				if (v.loop) v.i = 0;
+				else break;
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t blocks = 2000;
+	if (argc > 1) blocks = uint32_t(std::max(1, std::stoi(argv[1])));
+
+	//a small bank of sample data, ~0.5-2 seconds each (like the piano notes):
+	std::mt19937 mt(0x15466);
+	std::vector< std::vector< float > > bank(12);
+	for (auto &data : bank) {
+		data.resize(std::uniform_int_distribution< uint32_t >(AUDIO_RATE / 2, 2 * AUDIO_RATE)(mt));
+		float freq = std::uniform_real_distribution< float >(200.0f, 800.0f)(mt);
+		for (uint32_t i = 0; i < data.size(); ++i) {
+			data[i] = 0.25f * std::sin(2.0f * 3.1415926f * freq * float(i) / float(AUDIO_RATE));
+		}
+	}
+	std::vector< std::vector< int16_t > > bank_s16(bank.size());
+	for (size_t b = 0; b < bank.size(); ++b) {
+		for (float f : bank[b]) {
+			bank_s16[b].emplace_back(int16_t(std::lround(f * 32767.0f)));
+		}
+	}
+
+	std::cout << "Mixing " << blocks << " blocks of " << MIX_SAMPLES << " frames; times are per block (deadline is "
+	          << std::fixed << std::setprecision(1) << 1e6 * double(MIX_SAMPLES) / double(AUDIO_RATE) << " us)." << std::endl;
+
+	for (uint32_t voice_count : {16u, 64u, 256u}) {
+		std::vector< Voice > voices(voice_count);
+		for (auto &v : voices) {
+			size_t b = std::uniform_int_distribution< size_t >(0, bank.size()-1)(mt);
+			v.data = &bank[b];
+			v.data_s16 = &bank_s16[b];
+			v.i = std::uniform_int_distribution< uint32_t >(0, uint32_t(v.data->size()) - 1)(mt);
+			v.loop = true; //so every voice stays active for the whole run
+			v.start_l = std::uniform_real_distribution< float >(0.0f, 1.0f)(mt);
+			v.start_r = std::uniform_real_distribution< float >(0.0f, 1.0f)(mt);
+			v.end_l = std::uniform_real_distribution< float >(0.0f, 1.0f)(mt);
+			v.end_r = std::uniform_real_distribution< float >(0.0f, 1.0f)(mt);
+		}
+
+		//time a mixing loop over 'blocks' blocks, from the same starting voice state:
+		std::vector< float > buffer(2 * MIX_SAMPLES);
+		auto run = [&](auto &&mix) {
+			std::vector< Voice > state = voices;
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				std::fill(buffer.begin(), buffer.end(), 0.0f);
+				mix(state, buffer.data());
+			}
+			auto after = std::chrono::high_resolution_clock::now();
+			return std::chrono::duration< double, std::micro >(after - before).count() / double(blocks);
+		};
+
+		double reference_us = run(mix_reference);
+		std::vector< float > reference_out = buffer;
+
+		std::cout << std::setw(4) << voice_count << " voices: reference " << std::setprecision(1) << std::setw(8) << reference_us << " us";
+		for (auto const &kernel : get_supported_mix_kernels()) {
+			double us = run([&](std::vector< Voice > &state, float *out){ mix_kernel(kernel.mix_mono_ramp, state, out); });
+			//sanity check: kernels compute the same mix as the reference, up to float rounding:
+			float max_err = 0.0f;
+			for (size_t i = 0; i < buffer.size(); ++i) {
+				max_err = std::max(max_err, std::abs(buffer[i] - reference_out[i]));
+			}
+			std::cout << " | " << kernel.name << " " << std::setw(8) << us << " us (" << std::setprecision(2) << reference_us / us << "x";
+			if (max_err > 1e-3f) std::cout << ", MISMATCH " << max_err;
+			std::cout << ")" << std::setprecision(1);
+		}
+		std::cout << std::endl;
+
+		//16-bit data (half the memory traffic):
+		std::cout << "      16-bit data:";
+		std::vector< float > scalar_out;
+		for (auto const &kernel : get_supported_mix_kernels()) {
+			double us = run([&](std::vector< Voice > &state, float *out){ mix_kernel_s16(kernel.mix_mono_ramp_s16, state, out); });
+			//sanity check: kernels agree with the scalar version, up to float rounding:
+			if (scalar_out.empty()) scalar_out = buffer;
+			float max_err = 0.0f;
+			for (size_t i = 0; i < buffer.size(); ++i) {
+				max_err = std::max(max_err, std::abs(buffer[i] - scalar_out[i]));
+			}
+			std::cout << " | " << kernel.name << " " << std::setw(8) << us << " us (" << std::setprecision(2) << reference_us / us << "x";
+			if (max_err > 1e-3f) std::cout << ", MISMATCH " << max_err;
+			std::cout << ")" << std::setprecision(1);
+		}
+		std::cout << std::endl;
+	}
+
+	//resampling (one voice's worth of output per block):
+	std::cout << "Resampling " << MIX_SAMPLES << " frames (times are per block, per voice):" << std::endl;
+	for (float rate : {0.5f, 0.943874f, 1.5f, 3.0f}) {
+		std::vector< float > const &src = bank[0];
+		float const *table = get_resample_table(rate);
+		std::vector< float > out(MIX_SAMPLES);
+		std::vector< float > scalar_out;
+
+		std::cout << "  rate " << std::setprecision(3) << std::setw(5) << rate << ":" << std::setprecision(2);
+		for (auto const &kernel : get_supported_mix_kernels()) {
+			float position = 0.25f;
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				kernel.resample(table, src.data(), position, rate, MIX_SAMPLES, out.data());
+			}
+			auto after = std::chrono::high_resolution_clock::now();
+			double us = std::chrono::duration< double, std::micro >(after - before).count() / double(blocks);
+
+			//sanity check: kernels agree with the scalar version, up to float rounding:
+			if (scalar_out.empty()) scalar_out = out;
+			float max_err = 0.0f;
+			for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
+				max_err = std::max(max_err, std::abs(out[i] - scalar_out[i]));
+			}
+			std::cout << " | " << kernel.name << " " << std::setw(7) << us << " us";
+			if (max_err > 1e-4f) std::cout << " (MISMATCH " << max_err << ")";
+		}
+		std::cout << std::endl;
+	}
+
+	//panning (start and end gains for a block's worth of 3D voices):
+	std::cout << "Panning 3D voices (times are per block):" << std::endl;
+	for (uint32_t voice_count : {16u, 64u, 256u, 1024u}) {
+		uint32_t entries = 2 * voice_count; //(start and end of block)
+		std::vector< float > x(entries), y(entries), z(entries), radius(entries), volume(entries);
+		for (uint32_t i = 0; i < entries; ++i) {
+			x[i] = std::uniform_real_distribution< float >(-20.0f, 20.0f)(mt);
+			y[i] = std::uniform_real_distribution< float >(-20.0f, 20.0f)(mt);
+			z[i] = std::uniform_real_distribution< float >(-2.0f, 2.0f)(mt);
+			radius[i] = std::uniform_real_distribution< float >(1.0f, 10.0f)(mt);
+			volume[i] = std::uniform_real_distribution< float >(0.0f, 1.0f)(mt);
+		}
+		float const listener_position[3] = {0.5f, -1.0f, 0.0f};
+		float const listener_right[3] = {0.6f, 0.8f, 0.0f};
+		std::vector< float > ref_l(entries), ref_r(entries);
+
+		//the per-voice panning mix_audio used before the panning kernels:
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t b = 0; b < blocks; ++b) {
+			for (uint32_t i = 0; i < entries; ++i) {
+				float tx = x[i] - listener_position[0], ty = y[i] - listener_position[1], tz = z[i] - listener_position[2];
+				float distance = std::sqrt(tx * tx + ty * ty + tz * tz);
+				float amt = (listener_right[0] * tx + listener_right[1] * ty + listener_right[2] * tz) / distance;
+				float ang = 0.5f * 3.1415926f * (0.5f * (amt + 1.0f));
+				float att = 1.0f / (1.0f + (distance / radius[i]));
+				ref_l[i] = std::cos(ang) * att * volume[i];
+				ref_r[i] = std::sin(ang) * att * volume[i];
+			}
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		double reference_us = std::chrono::duration< double, std::micro >(after - before).count() / double(blocks);
+		std::cout << std::setw(6) << voice_count << " voices: reference " << std::setprecision(2) << std::setw(7) << reference_us << " us";
+
+		std::vector< float > pan(entries), gain(entries), left(entries), right(entries);
+		for (auto const &kernel : get_supported_mix_kernels()) {
+			before = std::chrono::high_resolution_clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				std::copy(volume.begin(), volume.end(), gain.begin());
+				kernel.pan_from_3D(listener_position, listener_right, x.data(), y.data(), z.data(), radius.data(), entries, pan.data(), gain.data());
+				kernel.pan_gains(pan.data(), gain.data(), entries, left.data(), right.data());
+			}
+			after = std::chrono::high_resolution_clock::now();
+			double us = std::chrono::duration< double, std::micro >(after - before).count() / double(blocks);
+
+			//sanity check: gains match the reference, and power is preserved (the equal-power guarantee):
+			float max_err = 0.0f;
+			float max_power_err = 0.0f;
+			for (uint32_t i = 0; i < entries; ++i) {
+				max_err = std::max(max_err, std::max(std::abs(left[i] - ref_l[i]), std::abs(right[i] - ref_r[i])));
+				float power = left[i] * left[i] + right[i] * right[i];
+				max_power_err = std::max(max_power_err, std::abs(power - gain[i] * gain[i]) / std::max(gain[i] * gain[i], 1e-20f));
+			}
+			std::cout << " | " << kernel.name << " " << std::setw(7) << us << " us (" << reference_us / us << "x";
+			if (max_err > 1e-5f) std::cout << ", MISMATCH " << max_err;
+			if (max_power_err > 1e-6f) std::cout << ", POWER ERROR " << max_power_err;
+			std::cout << ")";
+		}
+		std::cout << std::endl;
+	}
+
+	//convolution reverb (one block of mono send in, stereo out):
+	std::cout << "Convolution reverb, " << MIX_SAMPLES << "-frame blocks (times are per block):" << std::endl;
+	for (float seconds : {0.5f, 1.0f, 2.0f, 4.0f}) {
+		std::vector< float > left(uint32_t(seconds * float(AUDIO_RATE))), right(left.size());
+		for (size_t i = 0; i < left.size(); ++i) {
+			float decay = std::exp(-6.9f * float(i) / float(left.size())); //(-60dB by the end)
+			left[i] = decay * std::uniform_real_distribution< float >(-0.1f, 0.1f)(mt);
+			right[i] = decay * std::uniform_real_distribution< float >(-0.1f, 0.1f)(mt);
+		}
+		std::vector< float > input(MIX_SAMPLES), out(2 * MIX_SAMPLES);
+		std::vector< float > scalar_out;
+
+		std::cout << "  " << std::setprecision(1) << std::setw(4) << seconds << " s impulse:" << std::setprecision(2);
+		for (auto const &kernel : get_supported_mix_kernels()) {
+			ConvolutionReverb reverb(left, right, MIX_SAMPLES, kernel);
+			std::mt19937 noise(0x5eed);
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				for (auto &f : input) f = std::uniform_real_distribution< float >(-1.0f, 1.0f)(noise);
+				reverb.process(input.data(), out.data());
+			}
+			auto after = std::chrono::high_resolution_clock::now();
+			double us = std::chrono::duration< double, std::micro >(after - before).count() / double(blocks);
+
+			//sanity check: kernels agree with the scalar version, up to float rounding:
+			if (scalar_out.empty()) scalar_out = out;
+			float max_err = 0.0f;
+			for (size_t i = 0; i < out.size(); ++i) {
+				max_err = std::max(max_err, std::abs(out[i] - scalar_out[i]));
+			}
+			std::cout << " | " << kernel.name << " " << std::setw(7) << us << " us (" << reverb.partitions << " partitions)";
+			if (max_err > 1e-3f) std::cout << " (MISMATCH " << max_err << ")";
+		}
+		std::cout << std::endl;
+	}
+
+	//synthesized notes (each note's partials summed into one block, as mix_block does before mixing it in):
+	ModalSynth synth;
+	std::cout << "Synthesized notes, " << MIX_SAMPLES << "-frame blocks (times are per block):" << std::endl;
+	for (uint32_t note_count : {16u, 64u, 128u}) {
+		//notes spread over the piano's range (A0 - C8), as a busy piece might have:
+		std::vector< ModalSynth::Note const * > notes;
+		uint32_t partials = 0;
+		for (uint32_t n = 0; n < note_count; ++n) {
+			notes.emplace_back(&synth.notes[21 + (n * 37) % 88]);
+			partials += notes.back()->partials;
+		}
+		std::vector< float > out(MIX_SAMPLES);
+		std::vector< float > scalar_out;
+
+		std::cout << std::setw(6) << note_count << " notes (" << partials << " partials):" << std::setprecision(2);
+		for (auto const &kernel : get_supported_mix_kernels()) {
+			std::vector< float > z_re(note_count * ModalSynth::MaxPartials), z_im(z_re.size());
+			for (uint32_t n = 0; n < note_count; ++n) {
+				synth.start(uint8_t(notes[n] - synth.notes.data()), 1.0f, &z_re[n * ModalSynth::MaxPartials], &z_im[n * ModalSynth::MaxPartials]);
+			}
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t b = 0; b < blocks; ++b) {
+				for (uint32_t n = 0; n < note_count; ++n) {
+					std::fill(out.begin(), out.end(), 0.0f);
+					kernel.oscillator_bank(&z_re[n * ModalSynth::MaxPartials], &z_im[n * ModalSynth::MaxPartials], notes[n]->w_re, notes[n]->w_im, notes[n]->partials, out.data(), MIX_SAMPLES);
+					ModalSynth::settle(*notes[n], &z_re[n * ModalSynth::MaxPartials], &z_im[n * ModalSynth::MaxPartials]);
+				}
+			}
+			auto after = std::chrono::high_resolution_clock::now();
+			double us = std::chrono::duration< double, std::micro >(after - before).count() / double(blocks);
+
+			//sanity check: kernels agree with the scalar version, up to float rounding:
+			if (scalar_out.empty()) scalar_out = out;
+			float max_err = 0.0f;
+			for (size_t i = 0; i < out.size(); ++i) {
+				max_err = std::max(max_err, std::abs(out[i] - scalar_out[i]));
+			}
+			std::cout << " | " << kernel.name << " " << std::setw(7) << us << " us";
+			if (max_err > 1e-3f) std::cout << " (MISMATCH " << max_err << ")";
+		}
+		std::cout << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+//Benchmark for Scene::TransformStore's hierarchy update.
+// Builds a city-sized hierarchy (city -> districts -> blocks -> buildings -> parts),
+// then times update() and update_parallel() on pools of 2...N threads, both after
+// moving every transform and after moving a tenth of the buildings (a more typical frame).
+// Each parallel result is checked against the serial one; they should match exactly.
+// Finally, times each transform_kernel variant's matrix setup for drawing against the
+// one-drawable-at-a-time glm code Scene::draw used before the kernels existed.
+//
+//Usage:
+//  bench-transforms [frames] [max threads]
+
+#include "Scene.hpp"
+#include "ThreadPool.hpp"
+#include "transform_kernel.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t frames = 200;
+	if (argc > 1) frames = uint32_t(std::max(1, std::stoi(argv[1])));
+	uint32_t max_threads = std::max(2u, std::thread::hardware_concurrency());
+	if (argc > 2) max_threads = uint32_t(std::max(2, std::stoi(argv[2])));
+
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > offset(-10.0f, 10.0f);
+	std::uniform_real_distribution< float > angle(-3.1415926f, 3.1415926f);
+
+	Scene scene;
+	std::vector< Scene::Transform * > buildings;
+	auto add = [&](Scene::Transform *parent) {
+		Scene::Transform *t = scene.add_transform();
+		t->set_parent(parent);
+		t->set_position(glm::vec3(offset(mt), offset(mt), offset(mt)));
+		t->set_rotation(glm::angleAxis(angle(mt), glm::vec3(0.0f, 0.0f, 1.0f)));
+		return t;
+	};
+	Scene::Transform *city = add(nullptr);
+	for (uint32_t district = 0; district < 64; ++district) {
+		Scene::Transform *d = add(city);
+		for (uint32_t block = 0; block < 16; ++block) {
+			Scene::Transform *b = add(d);
+			for (uint32_t building = 0; building < 8; ++building) {
+				buildings.emplace_back(add(b));
+				for (uint32_t part = 0; part < 6; ++part) {
+					add(buildings.back());
+				}
+			}
+		}
+	}
+
+	Scene::TransformStore &store = scene.transform_store;
+	store.update();
+	std::cout << "Updating " << store.size() << " transforms; times are per frame." << std::endl;
+
+	//the two kinds of frame:
+	auto move_everything = [&]() {
+		for (auto &t : scene.transforms) {
+			t.set_position(t.get_position());
+		}
+	};
+	auto move_buildings = [&]() {
+		for (uint32_t i = 0; i < buildings.size(); i += 10) {
+			buildings[i]->set_rotation(buildings[i]->get_rotation());
+		}
+	};
+
+	struct Frame {
+		char const *name;
+		std::function< void() > move;
+	};
+	for (Frame const &frame : { Frame{"all moved", move_everything}, Frame{"1/10 of buildings moved", move_buildings} }) {
+		//time 'frames' updates (not counting the time spent marking transforms as moved):
+		auto run = [&](auto &&update) {
+			double total = 0.0;
+			for (uint32_t f = 0; f < frames; ++f) {
+				frame.move();
+				auto before = std::chrono::high_resolution_clock::now();
+				update();
+				auto after = std::chrono::high_resolution_clock::now();
+				total += std::chrono::duration< double >(after - before).count();
+			}
+			return 1e6 * total / frames;
+		};
+
+		//scramble the world matrices so a stale result can't pass the check below:
+		auto scramble = [&]() {
+			for (auto &m : store.local_to_world) m = glm::mat4x3(0.0f);
+			for (auto &m : store.world_to_local) m = glm::mat4x3(0.0f);
+			move_everything();
+		};
+
+		scramble();
+		double serial_us = run([&](){ store.update(); });
+		std::vector< glm::mat4x3 > expected_l2w = store.local_to_world;
+		std::vector< glm::mat4x3 > expected_w2l = store.world_to_local;
+
+		std::cout << frame.name << ":" << std::endl;
+		std::cout << "   1 thread  (update)          " << std::fixed << std::setprecision(1) << std::setw(8) << serial_us << " us" << std::endl;
+		for (uint32_t threads = 2; threads <= max_threads; ++threads) {
+			ThreadPool pool(threads - 1);
+			scramble();
+			double us = run([&](){ store.update_parallel(pool); });
+			bool match = std::memcmp(expected_l2w.data(), store.local_to_world.data(), sizeof(glm::mat4x3) * expected_l2w.size()) == 0
+			          && std::memcmp(expected_w2l.data(), store.world_to_local.data(), sizeof(glm::mat4x3) * expected_w2l.size()) == 0;
+			std::cout << "  " << std::setw(2) << threads << " threads (update_parallel) " << std::setw(8) << us << " us ("
+			          << std::setprecision(2) << serial_us / us << "x" << (match ? "" : ", MISMATCH") << ")" << std::setprecision(1) << std::endl;
+		}
+	}
+
+	//draw matrix setup for every building and part:
+	{
+		std::vector< glm::mat4x3 > object_to_world;
+		for (auto &t : scene.transforms) {
+			if (t.get_parent() && t.get_parent()->get_parent() && t.get_parent()->get_parent()->get_parent()) {
+				object_to_world.emplace_back(t.get_local_to_world());
+			}
+		}
+		uint32_t count = uint32_t(object_to_world.size());
+		glm::mat4 world_to_clip = glm::infinitePerspective(1.0f, 1.5f, 0.1f) * glm::mat4(store.world_to_local[0]);
+		glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
+
+		std::vector< glm::mat4 > object_to_clip(count);
+		std::vector< glm::mat4x3 > object_to_light(count);
+		std::vector< glm::mat3 > normal_to_light(count);
+		auto time = [&](auto &&setup) {
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t f = 0; f < frames; ++f) {
+				setup();
+			}
+			auto after = std::chrono::high_resolution_clock::now();
+			return 1e9 * std::chrono::duration< double >(after - before).count() / frames / count;
+		};
+
+		//the loop from Scene::draw before the kernels existed (kept here as a baseline):
+		double reference_ns = time([&](){
+			for (uint32_t d = 0; d < count; ++d) {
+				object_to_clip[d] = world_to_clip * glm::mat4(object_to_world[d]);
+				object_to_light[d] = world_to_light * glm::mat4(object_to_world[d]);
+				normal_to_light[d] = glm::inverse(glm::transpose(glm::mat3(object_to_light[d])));
+			}
+		});
+		std::cout << "Draw matrices for " << count << " drawables (times are per drawable): reference " << std::setprecision(1) << reference_ns << " ns";
+		std::vector< glm::mat3 > expected_normal = normal_to_light;
+		for (TransformKernel const &kernel : get_supported_transform_kernels()) {
+			double ns = time([&](){
+				kernel.draw_matrices(glm::value_ptr(world_to_clip), glm::value_ptr(world_to_light),
+					glm::value_ptr(object_to_world[0]), count,
+					glm::value_ptr(object_to_clip[0]), glm::value_ptr(object_to_light[0]), glm::value_ptr(normal_to_light[0]));
+			});
+			float max_err = 0.0f;
+			for (uint32_t d = 0; d < count; ++d) {
+				for (uint32_t c = 0; c < 3; ++c) {
+					for (uint32_t r = 0; r < 3; ++r) {
+						max_err = std::max(max_err, std::abs(normal_to_light[d][c][r] - expected_normal[d][c][r]));
+					}
+				}
+			}
+			std::cout << " | " << kernel.name << " " << ns << " ns (" << std::setprecision(2) << reference_ns / ns << "x";
+			if (max_err > 1e-3f) std::cout << ", MISMATCH " << max_err;
+			std::cout << ")" << std::setprecision(1);
+		}
+		std::cout << std::endl;
+	}
+
+	return 0;
+}
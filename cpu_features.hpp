@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * Helpers for code that has SIMD versions (see mix_kernel.cpp, transform_kernel.cpp).
+ *
+ * CPU_X86 is 1 when compiling for x86-64 (where SSE2 is always available).
+ * Functions that use AVX2 intrinsics must be marked CPU_TARGET_AVX2,
+ *  and only called when cpu_has_avx2() says the running CPU supports it.
+ *
+ */
+
+#if defined(__x86_64__) || defined(_M_X64)
+	#define CPU_X86 1
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		//MSVC will happily compile AVX2 intrinsics in any function:
+		#define CPU_TARGET_AVX2
+	#else
+		//gcc/clang need to be told which functions may use AVX2:
+		#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#else
+	#define CPU_X86 0
+#endif
+
+#if CPU_X86
+inline bool cpu_has_avx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!(osxsave && avx)) return false;
+	//make sure the OS saves the YMM registers on context switch:
+	if ((_xgetbv(0) & 0x6) != 0x6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif //CPU_X86
@@ -109,7 +109,8 @@ int main(int argc, char **argv) {
 	//SDL_ShowCursor(SDL_DISABLE);
 
 	//------------ init sound --------------
-	Sound::init();
+	//(small blocks, so notes follow key presses closely -- ~5ms per block rather than the default ~21ms)
+	Sound::init(256, 0, 256);
 
 	//------------ load assets --------------
 	call_load_functions();
@@ -0,0 +1,673 @@
+#include "mix_kernel.hpp"
+#include "cpu_features.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//cos(pi/2 * t) for t in [0,1] is approximated as (1 - t^2)(1 + u (C1 + u (C2 + u C3))), u = t^2;
+// coefficients were fit for minimax error, with the endpoints exact (so hard-panned voices are silent in one ear):
+static constexpr float const PAN_C1 = -0.233698696f;
+static constexpr float const PAN_C2 = 0.0199532323f;
+static constexpr float const PAN_C3 = -0.000858200598f;
+
+//------------------------ scalar --------------------------------
+
+static void mix_mono_ramp_scalar(float const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	//n.b. gain computed from the frame index (rather than accumulated) so all kernels agree;
+	// the index is tracked as a float to avoid an int->float conversion per frame:
+	float kf = 0.0f;
+	for (uint32_t k = 0; k < count; ++k) {
+		float l = left + kf * left_step;
+		float r = right + kf * right_step;
+		dst[2*k+0] += l * src[k];
+		dst[2*k+1] += r * src[k];
+		kf += 1.0f;
+	}
+}
+
+static void mix_mono_ramp_s16_scalar(int16_t const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	float kf = 0.0f;
+	for (uint32_t k = 0; k < count; ++k) {
+		float l = left + kf * left_step;
+		float r = right + kf * right_step;
+		float v = float(src[k]) * (1.0f / 32768.0f);
+		dst[2*k+0] += l * v;
+		dst[2*k+1] += r * v;
+		kf += 1.0f;
+	}
+}
+
+static void resample_scalar(float const *table, float const *src, float position, float step, uint32_t count, float *dst) {
+	for (uint32_t k = 0; k < count; ++k) {
+		float p = position + float(k) * step;
+		float whole = std::floor(p);
+		//pick the two nearest rows of the filter table and blend between them:
+		float phase = (p - whole) * float(RESAMPLE_PHASES);
+		uint32_t row = std::min(uint32_t(phase), RESAMPLE_PHASES - 1);
+		float t = phase - float(row);
+		float const *a = table + row * RESAMPLE_TAPS;
+		float const *b = a + RESAMPLE_TAPS;
+		float const *s = src + int32_t(whole);
+		float sum = 0.0f;
+		for (uint32_t j = 0; j < RESAMPLE_TAPS; ++j) {
+			sum += (a[j] + t * (b[j] - a[j])) * s[j];
+		}
+		dst[k] = sum;
+	}
+}
+
+static inline float pan_cos_scalar(float t) {
+	float u = t * t;
+	return (1.0f - u) * (1.0f + u * (PAN_C1 + u * (PAN_C2 + u * PAN_C3)));
+}
+
+static void pan_gains_scalar(float const *pan, float const *gain, uint32_t count, float *left, float *right) {
+	for (uint32_t i = 0; i < count; ++i) {
+		float t = 0.5f * (std::max(-1.0f, std::min(1.0f, pan[i])) + 1.0f); //0 (left) .. 1 (right)
+		left[i] = gain[i] * pan_cos_scalar(t);
+		right[i] = gain[i] * pan_cos_scalar(1.0f - t); //(sin(pi/2 * t) == cos(pi/2 * (1-t)))
+	}
+}
+
+static void pan_from_3D_scalar(float const listener_position[3], float const listener_right[3], float const *x, float const *y, float const *z, float const *half_radius, uint32_t count, float *pan, float *gain) {
+	for (uint32_t i = 0; i < count; ++i) {
+		float tx = x[i] - listener_position[0];
+		float ty = y[i] - listener_position[1];
+		float tz = z[i] - listener_position[2];
+		float distance = std::sqrt(tx * tx + ty * ty + tz * tz);
+		if (distance == 0.0f) {
+			pan[i] = 0.0f;
+			gain[i] *= 2.0f;
+		} else {
+			pan[i] = (listener_right[0] * tx + listener_right[1] * ty + listener_right[2] * tz) / distance;
+			//linear (not squared) distance attenuation; 0.5 at distance == half_radius:
+			gain[i] *= 1.0f / (1.0f + distance / half_radius[i]);
+		}
+	}
+}
+
+static void fft_pass_scalar(float *re, float *im, uint32_t count, uint32_t half, float const *twiddle_re, float const *twiddle_im) {
+	for (uint32_t g = 0; g < count; g += 2 * half) {
+		float *a_re = re + g, *a_im = im + g;
+		float *b_re = a_re + half, *b_im = a_im + half;
+		for (uint32_t j = 0; j < half; ++j) {
+			float t_re = b_re[j] * twiddle_re[j] - b_im[j] * twiddle_im[j];
+			float t_im = b_re[j] * twiddle_im[j] + b_im[j] * twiddle_re[j];
+			b_re[j] = a_re[j] - t_re;
+			b_im[j] = a_im[j] - t_im;
+			a_re[j] += t_re;
+			a_im[j] += t_im;
+		}
+	}
+}
+
+static void complex_multiply_add_scalar(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	for (uint32_t k = 0; k < count; ++k) {
+		acc_re[k] += a_re[k] * b_re[k] - a_im[k] * b_im[k];
+		acc_im[k] += a_re[k] * b_im[k] + a_im[k] * b_re[k];
+	}
+}
+
+static void oscillator_bank_scalar(float *z_re, float *z_im, float const *w_re, float const *w_im, uint32_t count, float *out, uint32_t frames) {
+	for (uint32_t p = 0; p < count; ++p) {
+		float re = z_re[p], im = z_im[p];
+		for (uint32_t k = 0; k < frames; ++k) {
+			out[k] += im;
+			float next_re = re * w_re[p] - im * w_im[p];
+			im = re * w_im[p] + im * w_re[p];
+			re = next_re;
+		}
+		z_re[p] = re;
+		z_im[p] = im;
+	}
+}
+
+#if CPU_X86
+
+//------------------------ SSE2 --------------------------------
+//(SSE2 is part of the x86-64 baseline, so this kernel is always available there)
+
+static void mix_mono_ramp_sse2(float const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	//gains for frames (k, k+1) are laid out as [ l r l r ], matching the output:
+	__m128 gain_base = _mm_setr_ps(left, right, left, right);
+	__m128 gain_step = _mm_setr_ps(left_step, right_step, left_step, right_step);
+	__m128 k_lo = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f); //frame index for each lane of the first output vector
+	__m128 k_hi = _mm_setr_ps(2.0f, 2.0f, 3.0f, 3.0f); //...and of the second
+	__m128 const four = _mm_set1_ps(4.0f);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 s = _mm_loadu_ps(src + k);
+		__m128 s_lo = _mm_unpacklo_ps(s, s); //[ s0 s0 s1 s1 ]
+		__m128 s_hi = _mm_unpackhi_ps(s, s); //[ s2 s2 s3 s3 ]
+
+		__m128 g_lo = _mm_add_ps(gain_base, _mm_mul_ps(k_lo, gain_step));
+		__m128 g_hi = _mm_add_ps(gain_base, _mm_mul_ps(k_hi, gain_step));
+
+		float *out = dst + 2*k;
+		_mm_storeu_ps(out + 0, _mm_add_ps(_mm_loadu_ps(out + 0), _mm_mul_ps(g_lo, s_lo)));
+		_mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(g_hi, s_hi)));
+
+		k_lo = _mm_add_ps(k_lo, four);
+		k_hi = _mm_add_ps(k_hi, four);
+	}
+
+	//leftover frames:
+	if (k < count) {
+		mix_mono_ramp_scalar(src + k, count - k, dst + 2*k,
+			left + float(k) * left_step, right + float(k) * right_step,
+			left_step, right_step);
+	}
+}
+
+static void mix_mono_ramp_s16_sse2(int16_t const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	__m128 gain_base = _mm_setr_ps(left, right, left, right);
+	__m128 gain_step = _mm_setr_ps(left_step, right_step, left_step, right_step);
+	__m128 k_lo = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+	__m128 k_hi = _mm_setr_ps(2.0f, 2.0f, 3.0f, 3.0f);
+	__m128 const four = _mm_set1_ps(4.0f);
+	__m128 const scale = _mm_set1_ps(1.0f / 32768.0f);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		//widen four 16-bit values to 32-bit (placing each in the high half, then shifting down to sign-extend):
+		__m128i w = _mm_loadl_epi64(reinterpret_cast< __m128i const * >(src + k));
+		__m128i i = _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16);
+		__m128 s = _mm_mul_ps(_mm_cvtepi32_ps(i), scale);
+		__m128 s_lo = _mm_unpacklo_ps(s, s);
+		__m128 s_hi = _mm_unpackhi_ps(s, s);
+
+		__m128 g_lo = _mm_add_ps(gain_base, _mm_mul_ps(k_lo, gain_step));
+		__m128 g_hi = _mm_add_ps(gain_base, _mm_mul_ps(k_hi, gain_step));
+
+		float *out = dst + 2*k;
+		_mm_storeu_ps(out + 0, _mm_add_ps(_mm_loadu_ps(out + 0), _mm_mul_ps(g_lo, s_lo)));
+		_mm_storeu_ps(out + 4, _mm_add_ps(_mm_loadu_ps(out + 4), _mm_mul_ps(g_hi, s_hi)));
+
+		k_lo = _mm_add_ps(k_lo, four);
+		k_hi = _mm_add_ps(k_hi, four);
+	}
+
+	if (k < count) {
+		mix_mono_ramp_s16_scalar(src + k, count - k, dst + 2*k,
+			left + float(k) * left_step, right + float(k) * right_step,
+			left_step, right_step);
+	}
+}
+
+static void resample_sse2(float const *table, float const *src, float position, float step, uint32_t count, float *dst) {
+	static_assert(RESAMPLE_TAPS == 16, "SSE2 resampler is written for 16 taps");
+	for (uint32_t k = 0; k < count; ++k) {
+		float p = position + float(k) * step;
+		float whole = std::floor(p);
+		float phase = (p - whole) * float(RESAMPLE_PHASES);
+		uint32_t row = std::min(uint32_t(phase), RESAMPLE_PHASES - 1);
+		__m128 t = _mm_set1_ps(phase - float(row));
+		float const *a = table + row * RESAMPLE_TAPS;
+		float const *b = a + RESAMPLE_TAPS;
+		float const *s = src + int32_t(whole);
+
+		__m128 sum = _mm_setzero_ps();
+		for (uint32_t j = 0; j < RESAMPLE_TAPS; j += 4) {
+			__m128 ha = _mm_loadu_ps(a + j);
+			__m128 h = _mm_add_ps(ha, _mm_mul_ps(t, _mm_sub_ps(_mm_loadu_ps(b + j), ha)));
+			sum = _mm_add_ps(sum, _mm_mul_ps(h, _mm_loadu_ps(s + j)));
+		}
+		//horizontal add:
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		dst[k] = _mm_cvtss_f32(sum);
+	}
+}
+
+static inline __m128 pan_cos_sse2(__m128 t) {
+	__m128 u = _mm_mul_ps(t, t);
+	__m128 p = _mm_add_ps(_mm_set1_ps(PAN_C2), _mm_mul_ps(u, _mm_set1_ps(PAN_C3)));
+	p = _mm_add_ps(_mm_set1_ps(PAN_C1), _mm_mul_ps(u, p));
+	p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(u, p));
+	return _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(1.0f), u), p);
+}
+
+static void pan_gains_sse2(float const *pan, float const *gain, uint32_t count, float *left, float *right) {
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const half = _mm_set1_ps(0.5f);
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 p = _mm_max_ps(_mm_set1_ps(-1.0f), _mm_min_ps(one, _mm_loadu_ps(pan + i)));
+		__m128 t = _mm_mul_ps(half, _mm_add_ps(p, one));
+		__m128 g = _mm_loadu_ps(gain + i);
+		_mm_storeu_ps(left + i, _mm_mul_ps(g, pan_cos_sse2(t)));
+		_mm_storeu_ps(right + i, _mm_mul_ps(g, pan_cos_sse2(_mm_sub_ps(one, t))));
+	}
+	if (i < count) pan_gains_scalar(pan + i, gain + i, count - i, left + i, right + i);
+}
+
+static void pan_from_3D_sse2(float const listener_position[3], float const listener_right[3], float const *x, float const *y, float const *z, float const *half_radius, uint32_t count, float *pan, float *gain) {
+	__m128 const lx = _mm_set1_ps(listener_position[0]);
+	__m128 const ly = _mm_set1_ps(listener_position[1]);
+	__m128 const lz = _mm_set1_ps(listener_position[2]);
+	__m128 const rx = _mm_set1_ps(listener_right[0]);
+	__m128 const ry = _mm_set1_ps(listener_right[1]);
+	__m128 const rz = _mm_set1_ps(listener_right[2]);
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const two = _mm_set1_ps(2.0f);
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 tx = _mm_sub_ps(_mm_loadu_ps(x + i), lx);
+		__m128 ty = _mm_sub_ps(_mm_loadu_ps(y + i), ly);
+		__m128 tz = _mm_sub_ps(_mm_loadu_ps(z + i), lz);
+		__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+		__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, tx), _mm_mul_ps(ry, ty)), _mm_mul_ps(rz, tz));
+		__m128 att = _mm_div_ps(one, _mm_add_ps(one, _mm_div_ps(distance, _mm_loadu_ps(half_radius + i))));
+		//(voices at the listener get pan 0 and double gain, as in the scalar version)
+		__m128 at_listener = _mm_cmpeq_ps(distance, _mm_setzero_ps());
+		__m128 p = _mm_andnot_ps(at_listener, _mm_div_ps(dot, distance));
+		att = _mm_or_ps(_mm_and_ps(at_listener, two), _mm_andnot_ps(at_listener, att));
+		_mm_storeu_ps(pan + i, p);
+		_mm_storeu_ps(gain + i, _mm_mul_ps(_mm_loadu_ps(gain + i), att));
+	}
+	if (i < count) pan_from_3D_scalar(listener_position, listener_right, x + i, y + i, z + i, half_radius + i, count - i, pan + i, gain + i);
+}
+
+static void fft_pass_sse2(float *re, float *im, uint32_t count, uint32_t half, float const *twiddle_re, float const *twiddle_im) {
+	if (half < 4) {
+		fft_pass_scalar(re, im, count, half, twiddle_re, twiddle_im);
+		return;
+	}
+	for (uint32_t g = 0; g < count; g += 2 * half) {
+		float *a_re = re + g, *a_im = im + g;
+		float *b_re = a_re + half, *b_im = a_im + half;
+		for (uint32_t j = 0; j < half; j += 4) {
+			__m128 w_re = _mm_loadu_ps(twiddle_re + j);
+			__m128 w_im = _mm_loadu_ps(twiddle_im + j);
+			__m128 x_re = _mm_loadu_ps(b_re + j);
+			__m128 x_im = _mm_loadu_ps(b_im + j);
+			__m128 t_re = _mm_sub_ps(_mm_mul_ps(x_re, w_re), _mm_mul_ps(x_im, w_im));
+			__m128 t_im = _mm_add_ps(_mm_mul_ps(x_re, w_im), _mm_mul_ps(x_im, w_re));
+			__m128 y_re = _mm_loadu_ps(a_re + j);
+			__m128 y_im = _mm_loadu_ps(a_im + j);
+			_mm_storeu_ps(b_re + j, _mm_sub_ps(y_re, t_re));
+			_mm_storeu_ps(b_im + j, _mm_sub_ps(y_im, t_im));
+			_mm_storeu_ps(a_re + j, _mm_add_ps(y_re, t_re));
+			_mm_storeu_ps(a_im + j, _mm_add_ps(y_im, t_im));
+		}
+	}
+}
+
+static void complex_multiply_add_sse2(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 ar = _mm_loadu_ps(a_re + k), ai = _mm_loadu_ps(a_im + k);
+		__m128 br = _mm_loadu_ps(b_re + k), bi = _mm_loadu_ps(b_im + k);
+		_mm_storeu_ps(acc_re + k, _mm_add_ps(_mm_loadu_ps(acc_re + k), _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+		_mm_storeu_ps(acc_im + k, _mm_add_ps(_mm_loadu_ps(acc_im + k), _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+	}
+	if (k < count) complex_multiply_add_scalar(a_re + k, a_im + k, b_re + k, b_im + k, count - k, acc_re + k, acc_im + k);
+}
+
+//(helper for the SIMD oscillator banks) lane j of 'lanes' (a power of two) starts at z * w^j, and each step multiplies by w^lanes:
+static void oscillator_lanes(float z_re, float z_im, float w_re, float w_im, uint32_t lanes, float *lane_re, float *lane_im, float *step_re, float *step_im) {
+	lane_re[0] = z_re;
+	lane_im[0] = z_im;
+	for (uint32_t j = 1; j < lanes; ++j) {
+		lane_re[j] = lane_re[j-1] * w_re - lane_im[j-1] * w_im;
+		lane_im[j] = lane_re[j-1] * w_im + lane_im[j-1] * w_re;
+	}
+	*step_re = w_re;
+	*step_im = w_im;
+	for (uint32_t power = 1; power < lanes; power *= 2) {
+		float next_re = *step_re * *step_re - *step_im * *step_im;
+		*step_im = 2.0f * *step_re * *step_im;
+		*step_re = next_re;
+	}
+}
+
+//(G partials at a time, so the steps of one partial overlap with the others' instead of waiting on each other)
+template< uint32_t G >
+static void oscillator_group_sse2(float *z_re, float *z_im, float const *w_re, float const *w_im, float *out, uint32_t frames) {
+	uint32_t const vectors = frames / 4 * 4;
+	__m128 re[G], im[G], s_re[G], s_im[G];
+	for (uint32_t g = 0; g < G; ++g) {
+		float lane_re[4], lane_im[4], step_re, step_im;
+		oscillator_lanes(z_re[g], z_im[g], w_re[g], w_im[g], 4, lane_re, lane_im, &step_re, &step_im);
+		re[g] = _mm_loadu_ps(lane_re);
+		im[g] = _mm_loadu_ps(lane_im);
+		s_re[g] = _mm_set1_ps(step_re);
+		s_im[g] = _mm_set1_ps(step_im);
+	}
+	for (uint32_t k = 0; k < vectors; k += 4) {
+		__m128 sum = _mm_loadu_ps(out + k);
+		for (uint32_t g = 0; g < G; ++g) {
+			sum = _mm_add_ps(sum, im[g]);
+			__m128 next_re = _mm_sub_ps(_mm_mul_ps(re[g], s_re[g]), _mm_mul_ps(im[g], s_im[g]));
+			im[g] = _mm_add_ps(_mm_mul_ps(re[g], s_im[g]), _mm_mul_ps(im[g], s_re[g]));
+			re[g] = next_re;
+		}
+		_mm_storeu_ps(out + k, sum);
+	}
+	//lane 0 is now z * w^vectors; finish (and store) from there:
+	for (uint32_t g = 0; g < G; ++g) {
+		z_re[g] = _mm_cvtss_f32(re[g]);
+		z_im[g] = _mm_cvtss_f32(im[g]);
+	}
+	if (vectors < frames) oscillator_bank_scalar(z_re, z_im, w_re, w_im, G, out + vectors, frames - vectors);
+}
+
+static void oscillator_bank_sse2(float *z_re, float *z_im, float const *w_re, float const *w_im, uint32_t count, float *out, uint32_t frames) {
+	uint32_t p = 0;
+	for (; p + 2 <= count; p += 2) oscillator_group_sse2< 2 >(z_re + p, z_im + p, w_re + p, w_im + p, out, frames);
+	if (p < count) oscillator_group_sse2< 1 >(z_re + p, z_im + p, w_re + p, w_im + p, out, frames);
+}
+
+//------------------------ AVX2 --------------------------------
+
+CPU_TARGET_AVX2
+static void mix_mono_ramp_avx2(float const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	//gains for frames (k .. k+3) are laid out as [ l r l r l r l r ]:
+	__m256 gain_base = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+	__m256 gain_step = _mm256_setr_ps(left_step, right_step, left_step, right_step, left_step, right_step, left_step, right_step);
+	__m256 k_lo = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+	__m256 k_hi = _mm256_setr_ps(4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f);
+	__m256 const eight = _mm256_set1_ps(8.0f);
+	__m256i const dup_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	__m256i const dup_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 s = _mm256_loadu_ps(src + k);
+		__m256 s_lo = _mm256_permutevar8x32_ps(s, dup_lo); //[ s0 s0 s1 s1 s2 s2 s3 s3 ]
+		__m256 s_hi = _mm256_permutevar8x32_ps(s, dup_hi); //[ s4 s4 ... s7 s7 ]
+
+		__m256 g_lo = _mm256_add_ps(gain_base, _mm256_mul_ps(k_lo, gain_step));
+		__m256 g_hi = _mm256_add_ps(gain_base, _mm256_mul_ps(k_hi, gain_step));
+
+		float *out = dst + 2*k;
+		_mm256_storeu_ps(out + 0, _mm256_add_ps(_mm256_loadu_ps(out + 0), _mm256_mul_ps(g_lo, s_lo)));
+		_mm256_storeu_ps(out + 8, _mm256_add_ps(_mm256_loadu_ps(out + 8), _mm256_mul_ps(g_hi, s_hi)));
+
+		k_lo = _mm256_add_ps(k_lo, eight);
+		k_hi = _mm256_add_ps(k_hi, eight);
+	}
+
+	//leftover frames (fewer than eight):
+	if (k < count) {
+		mix_mono_ramp_sse2(src + k, count - k, dst + 2*k,
+			left + float(k) * left_step, right + float(k) * right_step,
+			left_step, right_step);
+	}
+}
+
+CPU_TARGET_AVX2
+static void mix_mono_ramp_s16_avx2(int16_t const *src, uint32_t count, float *dst, float left, float right, float left_step, float right_step) {
+	__m256 gain_base = _mm256_setr_ps(left, right, left, right, left, right, left, right);
+	__m256 gain_step = _mm256_setr_ps(left_step, right_step, left_step, right_step, left_step, right_step, left_step, right_step);
+	__m256 k_lo = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+	__m256 k_hi = _mm256_setr_ps(4.0f, 4.0f, 5.0f, 5.0f, 6.0f, 6.0f, 7.0f, 7.0f);
+	__m256 const eight = _mm256_set1_ps(8.0f);
+	__m256 const scale = _mm256_set1_ps(1.0f / 32768.0f);
+	__m256i const dup_lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+	__m256i const dup_hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256i i = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast< __m128i const * >(src + k)));
+		__m256 s = _mm256_mul_ps(_mm256_cvtepi32_ps(i), scale);
+		__m256 s_lo = _mm256_permutevar8x32_ps(s, dup_lo);
+		__m256 s_hi = _mm256_permutevar8x32_ps(s, dup_hi);
+
+		__m256 g_lo = _mm256_add_ps(gain_base, _mm256_mul_ps(k_lo, gain_step));
+		__m256 g_hi = _mm256_add_ps(gain_base, _mm256_mul_ps(k_hi, gain_step));
+
+		float *out = dst + 2*k;
+		_mm256_storeu_ps(out + 0, _mm256_add_ps(_mm256_loadu_ps(out + 0), _mm256_mul_ps(g_lo, s_lo)));
+		_mm256_storeu_ps(out + 8, _mm256_add_ps(_mm256_loadu_ps(out + 8), _mm256_mul_ps(g_hi, s_hi)));
+
+		k_lo = _mm256_add_ps(k_lo, eight);
+		k_hi = _mm256_add_ps(k_hi, eight);
+	}
+
+	if (k < count) {
+		mix_mono_ramp_s16_sse2(src + k, count - k, dst + 2*k,
+			left + float(k) * left_step, right + float(k) * right_step,
+			left_step, right_step);
+	}
+}
+
+CPU_TARGET_AVX2
+static void resample_avx2(float const *table, float const *src, float position, float step, uint32_t count, float *dst) {
+	static_assert(RESAMPLE_TAPS == 16, "AVX2 resampler is written for 16 taps");
+	for (uint32_t k = 0; k < count; ++k) {
+		float p = position + float(k) * step;
+		float whole = std::floor(p);
+		float phase = (p - whole) * float(RESAMPLE_PHASES);
+		uint32_t row = std::min(uint32_t(phase), RESAMPLE_PHASES - 1);
+		__m256 t = _mm256_set1_ps(phase - float(row));
+		float const *a = table + row * RESAMPLE_TAPS;
+		float const *b = a + RESAMPLE_TAPS;
+		float const *s = src + int32_t(whole);
+
+		__m256 ha0 = _mm256_loadu_ps(a + 0);
+		__m256 ha1 = _mm256_loadu_ps(a + 8);
+		__m256 h0 = _mm256_add_ps(ha0, _mm256_mul_ps(t, _mm256_sub_ps(_mm256_loadu_ps(b + 0), ha0)));
+		__m256 h1 = _mm256_add_ps(ha1, _mm256_mul_ps(t, _mm256_sub_ps(_mm256_loadu_ps(b + 8), ha1)));
+		__m256 sum8 = _mm256_add_ps(_mm256_mul_ps(h0, _mm256_loadu_ps(s + 0)), _mm256_mul_ps(h1, _mm256_loadu_ps(s + 8)));
+
+		//horizontal add:
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum8), _mm256_extractf128_ps(sum8, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		dst[k] = _mm_cvtss_f32(sum);
+	}
+}
+
+CPU_TARGET_AVX2
+static inline __m256 pan_cos_avx2(__m256 t) {
+	__m256 u = _mm256_mul_ps(t, t);
+	__m256 p = _mm256_add_ps(_mm256_set1_ps(PAN_C2), _mm256_mul_ps(u, _mm256_set1_ps(PAN_C3)));
+	p = _mm256_add_ps(_mm256_set1_ps(PAN_C1), _mm256_mul_ps(u, p));
+	p = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(u, p));
+	return _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), u), p);
+}
+
+CPU_TARGET_AVX2
+static void pan_gains_avx2(float const *pan, float const *gain, uint32_t count, float *left, float *right) {
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 const half = _mm256_set1_ps(0.5f);
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 p = _mm256_max_ps(_mm256_set1_ps(-1.0f), _mm256_min_ps(one, _mm256_loadu_ps(pan + i)));
+		__m256 t = _mm256_mul_ps(half, _mm256_add_ps(p, one));
+		__m256 g = _mm256_loadu_ps(gain + i);
+		_mm256_storeu_ps(left + i, _mm256_mul_ps(g, pan_cos_avx2(t)));
+		_mm256_storeu_ps(right + i, _mm256_mul_ps(g, pan_cos_avx2(_mm256_sub_ps(one, t))));
+	}
+	if (i < count) pan_gains_sse2(pan + i, gain + i, count - i, left + i, right + i);
+}
+
+CPU_TARGET_AVX2
+static void pan_from_3D_avx2(float const listener_position[3], float const listener_right[3], float const *x, float const *y, float const *z, float const *half_radius, uint32_t count, float *pan, float *gain) {
+	__m256 const lx = _mm256_set1_ps(listener_position[0]);
+	__m256 const ly = _mm256_set1_ps(listener_position[1]);
+	__m256 const lz = _mm256_set1_ps(listener_position[2]);
+	__m256 const rx = _mm256_set1_ps(listener_right[0]);
+	__m256 const ry = _mm256_set1_ps(listener_right[1]);
+	__m256 const rz = _mm256_set1_ps(listener_right[2]);
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 const two = _mm256_set1_ps(2.0f);
+	uint32_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 tx = _mm256_sub_ps(_mm256_loadu_ps(x + i), lx);
+		__m256 ty = _mm256_sub_ps(_mm256_loadu_ps(y + i), ly);
+		__m256 tz = _mm256_sub_ps(_mm256_loadu_ps(z + i), lz);
+		__m256 distance = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+		__m256 dot = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, tx), _mm256_mul_ps(ry, ty)), _mm256_mul_ps(rz, tz));
+		__m256 att = _mm256_div_ps(one, _mm256_add_ps(one, _mm256_div_ps(distance, _mm256_loadu_ps(half_radius + i))));
+		__m256 at_listener = _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_EQ_OQ);
+		__m256 p = _mm256_andnot_ps(at_listener, _mm256_div_ps(dot, distance));
+		att = _mm256_blendv_ps(att, two, at_listener);
+		_mm256_storeu_ps(pan + i, p);
+		_mm256_storeu_ps(gain + i, _mm256_mul_ps(_mm256_loadu_ps(gain + i), att));
+	}
+	if (i < count) pan_from_3D_sse2(listener_position, listener_right, x + i, y + i, z + i, half_radius + i, count - i, pan + i, gain + i);
+}
+
+CPU_TARGET_AVX2
+static void fft_pass_avx2(float *re, float *im, uint32_t count, uint32_t half, float const *twiddle_re, float const *twiddle_im) {
+	if (half < 8) {
+		fft_pass_sse2(re, im, count, half, twiddle_re, twiddle_im);
+		return;
+	}
+	for (uint32_t g = 0; g < count; g += 2 * half) {
+		float *a_re = re + g, *a_im = im + g;
+		float *b_re = a_re + half, *b_im = a_im + half;
+		for (uint32_t j = 0; j < half; j += 8) {
+			__m256 w_re = _mm256_loadu_ps(twiddle_re + j);
+			__m256 w_im = _mm256_loadu_ps(twiddle_im + j);
+			__m256 x_re = _mm256_loadu_ps(b_re + j);
+			__m256 x_im = _mm256_loadu_ps(b_im + j);
+			__m256 t_re = _mm256_sub_ps(_mm256_mul_ps(x_re, w_re), _mm256_mul_ps(x_im, w_im));
+			__m256 t_im = _mm256_add_ps(_mm256_mul_ps(x_re, w_im), _mm256_mul_ps(x_im, w_re));
+			__m256 y_re = _mm256_loadu_ps(a_re + j);
+			__m256 y_im = _mm256_loadu_ps(a_im + j);
+			_mm256_storeu_ps(b_re + j, _mm256_sub_ps(y_re, t_re));
+			_mm256_storeu_ps(b_im + j, _mm256_sub_ps(y_im, t_im));
+			_mm256_storeu_ps(a_re + j, _mm256_add_ps(y_re, t_re));
+			_mm256_storeu_ps(a_im + j, _mm256_add_ps(y_im, t_im));
+		}
+	}
+}
+
+CPU_TARGET_AVX2
+static void complex_multiply_add_avx2(float const *a_re, float const *a_im, float const *b_re, float const *b_im, uint32_t count, float *acc_re, float *acc_im) {
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 ar = _mm256_loadu_ps(a_re + k), ai = _mm256_loadu_ps(a_im + k);
+		__m256 br = _mm256_loadu_ps(b_re + k), bi = _mm256_loadu_ps(b_im + k);
+		//(no FMA: results match the other kernels exactly)
+		_mm256_storeu_ps(acc_re + k, _mm256_add_ps(_mm256_loadu_ps(acc_re + k), _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi))));
+		_mm256_storeu_ps(acc_im + k, _mm256_add_ps(_mm256_loadu_ps(acc_im + k), _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br))));
+	}
+	if (k < count) complex_multiply_add_sse2(a_re + k, a_im + k, b_re + k, b_im + k, count - k, acc_re + k, acc_im + k);
+}
+
+template< uint32_t G >
+CPU_TARGET_AVX2
+static void oscillator_group_avx2(float *z_re, float *z_im, float const *w_re, float const *w_im, float *out, uint32_t frames) {
+	uint32_t const vectors = frames / 8 * 8;
+	__m256 re[G], im[G], s_re[G], s_im[G];
+	for (uint32_t g = 0; g < G; ++g) {
+		float lane_re[8], lane_im[8], step_re, step_im;
+		oscillator_lanes(z_re[g], z_im[g], w_re[g], w_im[g], 8, lane_re, lane_im, &step_re, &step_im);
+		re[g] = _mm256_loadu_ps(lane_re);
+		im[g] = _mm256_loadu_ps(lane_im);
+		s_re[g] = _mm256_set1_ps(step_re);
+		s_im[g] = _mm256_set1_ps(step_im);
+	}
+	for (uint32_t k = 0; k < vectors; k += 8) {
+		__m256 sum = _mm256_loadu_ps(out + k);
+		for (uint32_t g = 0; g < G; ++g) {
+			sum = _mm256_add_ps(sum, im[g]);
+			__m256 next_re = _mm256_sub_ps(_mm256_mul_ps(re[g], s_re[g]), _mm256_mul_ps(im[g], s_im[g]));
+			im[g] = _mm256_add_ps(_mm256_mul_ps(re[g], s_im[g]), _mm256_mul_ps(im[g], s_re[g]));
+			re[g] = next_re;
+		}
+		_mm256_storeu_ps(out + k, sum);
+	}
+	//lane 0 is now z * w^vectors; finish (and store) from there:
+	for (uint32_t g = 0; g < G; ++g) {
+		z_re[g] = _mm_cvtss_f32(_mm256_castps256_ps128(re[g]));
+		z_im[g] = _mm_cvtss_f32(_mm256_castps256_ps128(im[g]));
+	}
+	if (vectors < frames) oscillator_bank_scalar(z_re, z_im, w_re, w_im, G, out + vectors, frames - vectors);
+}
+
+CPU_TARGET_AVX2
+static void oscillator_bank_avx2(float *z_re, float *z_im, float const *w_re, float const *w_im, uint32_t count, float *out, uint32_t frames) {
+	uint32_t p = 0;
+	for (; p + 2 <= count; p += 2) oscillator_group_avx2< 2 >(z_re + p, z_im + p, w_re + p, w_im + p, out, frames);
+	if (p < count) oscillator_group_avx2< 1 >(z_re + p, z_im + p, w_re + p, w_im + p, out, frames);
+}
+
+#endif //CPU_X86
+
+//------------------------ public-facing --------------------------------
+
+std::vector< MixKernel > const &get_supported_mix_kernels() {
+	static std::vector< MixKernel > kernels = [](){
+		std::vector< MixKernel > ret;
+		ret.emplace_back(MixKernel{"scalar", mix_mono_ramp_scalar, mix_mono_ramp_s16_scalar, resample_scalar, pan_gains_scalar, pan_from_3D_scalar, fft_pass_scalar, complex_multiply_add_scalar, oscillator_bank_scalar});
+		#if CPU_X86
+		ret.emplace_back(MixKernel{"sse2", mix_mono_ramp_sse2, mix_mono_ramp_s16_sse2, resample_sse2, pan_gains_sse2, pan_from_3D_sse2, fft_pass_sse2, complex_multiply_add_sse2, oscillator_bank_sse2});
+		if (cpu_has_avx2()) {
+			ret.emplace_back(MixKernel{"avx2", mix_mono_ramp_avx2, mix_mono_ramp_s16_avx2, resample_avx2, pan_gains_avx2, pan_from_3D_avx2, fft_pass_avx2, complex_multiply_add_avx2, oscillator_bank_avx2});
+		}
+		#endif
+		return ret;
+	}();
+	return kernels;
+}
+
+MixKernel const &get_mix_kernel() {
+	static MixKernel const &best = get_supported_mix_kernels().back();
+	return best;
+}
+
+//------------------------ resampling filters --------------------------------
+
+//filters are built for steps of 2^(i/4), i = 0 .. RESAMPLE_TABLES-1 (so up to two octaves up):
+static constexpr uint32_t const RESAMPLE_TABLES = 9;
+
+//zeroth-order modified Bessel function of the first kind (for the Kaiser window):
+static double bessel_i0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+	for (uint32_t k = 1; k < 32; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+//Kaiser-windowed sinc with cutoff 'cutoff' (as a fraction of the source Nyquist frequency):
+static void build_resample_table(double cutoff, float *table) {
+	constexpr double const pi = 3.14159265358979323846;
+	constexpr double const beta = 7.0; //window shape: larger is less ripple but a wider transition band
+	double const half_width = double(RESAMPLE_TAPS / 2);
+	for (uint32_t row = 0; row <= RESAMPLE_PHASES; ++row) {
+		double frac = double(row) / double(RESAMPLE_PHASES);
+		double coefs[RESAMPLE_TAPS];
+		double total = 0.0;
+		for (uint32_t j = 0; j < RESAMPLE_TAPS; ++j) {
+			//distance from the read position to this tap's source frame:
+			double x = double(j) - double(RESAMPLE_TAPS / 2 - 1) - frac;
+			double sinc = (x == 0.0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x));
+			double u = x / half_width;
+			double window = (std::abs(u) >= 1.0 ? 0.0 : bessel_i0(beta * std::sqrt(1.0 - u * u)) / bessel_i0(beta));
+			coefs[j] = cutoff * sinc * window;
+			total += coefs[j];
+		}
+		//normalize so that constant signals pass through unchanged:
+		for (uint32_t j = 0; j < RESAMPLE_TAPS; ++j) {
+			table[row * RESAMPLE_TAPS + j] = float(coefs[j] / total);
+		}
+	}
+}
+
+float const *get_resample_table(float step) {
+	static std::vector< float > const tables = [](){
+		std::vector< float > ret(RESAMPLE_TABLES * (RESAMPLE_PHASES + 1) * RESAMPLE_TAPS);
+		for (uint32_t i = 0; i < RESAMPLE_TABLES; ++i) {
+			//cutoff leaves a bit of room below the (output) Nyquist frequency for the filter's transition band:
+			double cutoff = 0.9 / std::pow(2.0, double(i) / 4.0);
+			build_resample_table(cutoff, ret.data() + i * (RESAMPLE_PHASES + 1) * RESAMPLE_TAPS);
+		}
+		return ret;
+	}();
+
+	//pick the first table whose step is at least 'step' (so its cutoff is low enough):
+	uint32_t i = 0;
+	if (step > 1.0f) {
+		i = std::min(uint32_t(std::ceil(4.0f * std::log2(step) - 1e-3f)), RESAMPLE_TABLES - 1);
+	}
+	return tables.data() + i * (RESAMPLE_PHASES + 1) * RESAMPLE_TAPS;
+}
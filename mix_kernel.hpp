@@ -0,0 +1,135 @@
+#pragma once
+
+/*
+ * Inner loops for the audio mixer (used by Sound.cpp's mix_audio).
+ *
+ * Each kernel mixes a contiguous run of mono sample data into an
+ *  interleaved stereo (LRLR...) buffer, adding to what is already there.
+ * 16-bit sample data is converted to floating point inside the kernel,
+ *  so it never needs a floating-point copy.
+ * Gains ramp linearly across the run, so the caller only needs to split
+ *  runs at loop/end boundaries of the source data.
+ *
+ * Resampling kernels (for playing samples back at other rates) use a
+ *  polyphase windowed-sinc filter: RESAMPLE_TAPS taps, with coefficients
+ *  interpolated between RESAMPLE_PHASES precomputed sub-sample offsets.
+ *
+ * Panning kernels compute the per-block gains of many voices at once,
+ *  from arrays of voice parameters.
+ *
+ * FFT kernels (used by RealFFT.hpp and the convolution reverb) work on
+ *  complex values stored "split" -- real and imaginary parts in separate arrays.
+ *
+ * Several versions (scalar, SSE2, AVX2) exist; get_mix_kernel() picks the
+ *  fastest one the running CPU supports.
+ *
+ */
+
+#include <cstdint>
+#include <vector>
+
+//mix 'count' frames of 'src' into 'dst' (interleaved stereo, so 2*count floats):
+// left gain at frame k is 'left + k * left_step', and similarly for right.
+typedef void (*MixMonoRampFn)(
+	float const *src, uint32_t count,
+	float *dst,
+	float left, float right,
+	float left_step, float right_step
+);
+
+//as above, but 'src' is 16-bit data (full scale 32768):
+typedef void (*MixMonoRampS16Fn)(
+	int16_t const *src, uint32_t count,
+	float *dst,
+	float left, float right,
+	float left_step, float right_step
+);
+
+constexpr uint32_t const RESAMPLE_TAPS = 16;
+constexpr uint32_t const RESAMPLE_PHASES = 256;
+
+//resample 'count' frames from 'src' into 'dst' (mono), reading at 'position + k * step' for frame k:
+// output frame k is the sum over taps j of h(frac(p), j) * src[floor(p) + j] where p = position + k * step,
+// so the center of the filter (tap RESAMPLE_TAPS/2 - 1) lands on src[floor(p) + RESAMPLE_TAPS/2 - 1].
+// That is, the caller must make sure src[floor(p) .. floor(p) + RESAMPLE_TAPS - 1] is readable for every frame.
+// 'table' is a filter table from get_resample_table().
+typedef void (*ResampleFn)(
+	float const *table,
+	float const *src,
+	float position, float step,
+	uint32_t count,
+	float *dst
+);
+
+//filter table (RESAMPLE_PHASES + 1 rows of RESAMPLE_TAPS coefficients) suitable for reading at 'step' source
+// frames per output frame -- for steps above one, the cutoff is lowered to avoid aliasing:
+float const *get_resample_table(float step);
+
+//equal-power panning for 'count' voices:
+// left[i] = gain[i] * cos(a) and right[i] = gain[i] * sin(a), where a = pi/4 * (1 + clamp(pan[i], -1, 1)).
+// (cos and sin are polynomial approximations: each is within 2e-7 of the true value, and
+//  left^2 + right^2 stays within 1e-6 of gain^2, so loudness doesn't wobble as voices pan)
+typedef void (*PanGainsFn)(
+	float const *pan, float const *gain,
+	uint32_t count,
+	float *left, float *right
+);
+
+//3D panning setup for 'count' voices at (x[i], y[i], z[i]):
+// sets pan[i] to the voice's direction (-1 = listener's left, 1 = listener's right) and
+// multiplies gain[i] by the distance attenuation 1 / (1 + distance / half_radius[i]).
+// (a voice exactly at the listener gets pan 0 and gain doubled -- sqrt(2) in each ear after PanGainsFn)
+typedef void (*PanFrom3DFn)(
+	float const listener_position[3], float const listener_right[3],
+	float const *x, float const *y, float const *z, float const *half_radius,
+	uint32_t count,
+	float *pan, float *gain
+);
+
+//one radix-2 (decimation-in-time) pass of a complex FFT over 'count' values, in place:
+// for each group of 2*half values starting at g, and each j in [0, half),
+//   b = x[g+j+half] * w[j];  x[g+j+half] = x[g+j] - b;  x[g+j] = x[g+j] + b
+// where w[j] = twiddle_re[j] + i * twiddle_im[j]. ('count' and 'half' are powers of two, half < count)
+typedef void (*FFTPassFn)(
+	float *re, float *im,
+	uint32_t count, uint32_t half,
+	float const *twiddle_re, float const *twiddle_im
+);
+
+//complex multiply-accumulate over 'count' values: acc[k] += a[k] * b[k]
+typedef void (*ComplexMultiplyAddFn)(
+	float const *a_re, float const *a_im,
+	float const *b_re, float const *b_im,
+	uint32_t count,
+	float *acc_re, float *acc_im
+);
+
+//bank of 'count' decaying sinusoids (e.g., the partials of a synthesized note), each kept as a complex phasor
+// z[p] that is multiplied by a fixed w[p] (decay * rotation) every frame:
+//   out[k] += sum over p of im(z[p] * w[p]^k) for k in [0, frames), then z[p] = z[p] * w[p]^frames.
+// (phasors are stepped a vector of frames at a time, so results differ from the scalar kernel by rounding)
+typedef void (*OscillatorBankFn)(
+	float *z_re, float *z_im,
+	float const *w_re, float const *w_im,
+	uint32_t count,
+	float *out, uint32_t frames
+);
+
+struct MixKernel {
+	char const *name; //for reporting, e.g. "avx2"
+	MixMonoRampFn mix_mono_ramp;
+	MixMonoRampS16Fn mix_mono_ramp_s16;
+	ResampleFn resample;
+	PanGainsFn pan_gains;
+	PanFrom3DFn pan_from_3D;
+	FFTPassFn fft_pass;
+	ComplexMultiplyAddFn complex_multiply_add;
+	OscillatorBankFn oscillator_bank;
+};
+
+//the best kernel for the running CPU (selected once, on first call):
+MixKernel const &get_mix_kernel();
+
+//every kernel the running CPU can execute, slowest (scalar) first:
+// (useful for benchmarking and cross-checking kernels against each other)
+std::vector< MixKernel > const &get_supported_mix_kernels();
@@ -0,0 +1,209 @@
+#include "pcm_cache.hpp"
+
+#include "data_path.hpp"
+#include "read_write_chunk.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+//bump when the cache file layout changes (old files are then ignored):
+static constexpr uint32_t const PCM_CACHE_VERSION = 1;
+
+static std::mutex cache_mutex; //(samples may be loaded from several threads)
+static bool cache_directory_set = false;
+static bool cache_directory_checked = false; //was the directory created and found to be writable?
+static std::string cache_directory;
+
+void set_pcm_cache_directory(std::string const &directory) {
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	cache_directory = directory;
+	cache_directory_set = true;
+	cache_directory_checked = false;
+}
+
+//value of an environment variable ("" if not set):
+static std::string get_environment(char const *name) {
+	#if defined(_WIN32)
+	char *value = nullptr;
+	size_t size = 0;
+	std::string ret;
+	if (_dupenv_s(&value, &size, name) == 0 && value) ret = value;
+	std::free(value);
+	return ret;
+	#else
+	char const *value = std::getenv(name);
+	return (value ? value : "");
+	#endif
+}
+
+//the default cache directory is per-user (the game's own folder is shipped as-is, and may be read-only):
+static std::string default_cache_directory() {
+	#if defined(_WIN32)
+	std::string base = get_environment("LOCALAPPDATA");
+	#elif defined(__APPLE__)
+	std::string base = get_environment("HOME");
+	if (base != "") base += "/Library/Caches";
+	#else
+	std::string base = get_environment("XDG_CACHE_HOME");
+	if (base == "") {
+		base = get_environment("HOME");
+		if (base != "") base += "/.cache";
+	}
+	#endif
+	if (base == "") return data_path("pcm-cache"); //(no user folder to be found)
+	return base + "/game-pcm-cache";
+}
+
+//create 'path' (and any missing parents); errors are ignored, since the caller checks the result by writing to it:
+static void make_directories(std::string const &path) {
+	for (size_t end = path.find_first_of("/\\", 1); ; end = path.find_first_of("/\\", end + 1)) {
+		std::string prefix = path.substr(0, end);
+		#if defined(_WIN32)
+		_mkdir(prefix.c_str());
+		#else
+		mkdir(prefix.c_str(), 0755);
+		#endif
+		if (end == std::string::npos) break;
+	}
+}
+
+static std::string get_cache_directory() {
+	std::lock_guard< std::mutex > lock(cache_mutex);
+	if (!cache_directory_set) {
+		cache_directory = default_cache_directory();
+		cache_directory_set = true;
+	}
+	if (!cache_directory_checked && cache_directory != "") {
+		//make sure the directory exists and can be written, or else turn the cache off (with a single warning):
+		make_directories(cache_directory);
+		std::string probe = cache_directory + "/.write-test";
+		bool writable = bool(std::ofstream(probe, std::ios::binary));
+		std::remove(probe.c_str());
+		if (!writable) {
+			std::cerr << "WARNING: can't write to pcm cache directory '" << cache_directory << "'; sounds will be decoded without caching." << std::endl;
+			cache_directory = "";
+		}
+	}
+	cache_directory_checked = true;
+	return cache_directory;
+}
+
+//64-bit FNV-1a hash:
+static uint64_t hash_bytes(char const *bytes, size_t count, uint64_t hash = 0xcbf29ce484222325ull) {
+	for (size_t i = 0; i < count; ++i) {
+		hash ^= uint64_t(uint8_t(bytes[i]));
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+//the cache key: hash of the source file's contents plus decoder settings:
+struct PcmCacheKey {
+	uint64_t content_hash = 0;
+	uint64_t decoder_hash = 0;
+	uint32_t version = PCM_CACHE_VERSION;
+	uint32_t padding = 0;
+};
+static_assert(sizeof(PcmCacheKey) == 24, "key is packed");
+
+void load_pcm_cached(std::string const &filename, std::string const &decoder, void (*load)(std::string const &, std::vector< float > *), std::vector< float > *data_) {
+	assert(load);
+	assert(data_);
+	auto &data = *data_;
+
+	std::string directory = get_cache_directory();
+	if (directory == "") {
+		load(filename, &data);
+		return;
+	}
+
+	//hash the source file:
+	PcmCacheKey key;
+	{
+		std::ifstream source(filename, std::ios::binary);
+		if (!source) {
+			//let the loader report the problem:
+			load(filename, &data);
+			return;
+		}
+		std::vector< char > buffer(1 << 16);
+		key.content_hash = 0xcbf29ce484222325ull;
+		while (source) {
+			source.read(buffer.data(), std::streamsize(buffer.size()));
+			key.content_hash = hash_bytes(buffer.data(), size_t(source.gcount()), key.content_hash);
+		}
+		key.decoder_hash = hash_bytes(decoder.data(), decoder.size());
+	}
+
+	//cache file is named after the source file (for the benefit of humans) and the key:
+	std::string name = filename.substr(filename.find_last_of("/\\") + 1);
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)(key.content_hash ^ (key.decoder_hash * 31)));
+	std::string cache_file = directory + "/" + name + "-" + hex + ".pcm";
+
+	//warm: read cached data:
+	{
+		std::ifstream cached(cache_file, std::ios::binary);
+		if (cached) {
+			try {
+				std::vector< PcmCacheKey > stored_key;
+				read_chunk(cached, "pck0", &stored_key);
+				if (stored_key.size() == 1
+				 && stored_key[0].content_hash == key.content_hash
+				 && stored_key[0].decoder_hash == key.decoder_hash
+				 && stored_key[0].version == key.version) {
+					read_chunk(cached, "pcm0", &data);
+					return;
+				}
+			} catch (std::exception const &e) {
+				std::cerr << "WARNING: ignoring unreadable cache file '" << cache_file << "': " << e.what() << std::endl;
+			}
+		}
+	}
+
+	//cold: decode, then try to save for next time:
+	load(filename, &data);
+	if (data.empty()) return; //(nothing worth caching)
+
+	//(write to a temporary name first, so a partial file is never mistaken for a complete one)
+	// (the name is unique to this write, so threads -- or other game instances -- caching the same file don't write over each other)
+	static std::atomic< uint32_t > temp_serial{0};
+	char temp_suffix[40];
+	snprintf(temp_suffix, sizeof(temp_suffix), ".%016llx-%u.tmp",
+		(unsigned long long)std::hash< std::thread::id >()(std::this_thread::get_id()),
+		unsigned(temp_serial.fetch_add(1, std::memory_order_relaxed)));
+	std::string temp_file = cache_file + temp_suffix;
+	{
+		std::ofstream out(temp_file, std::ios::binary);
+		write_chunk("pck0", std::vector< PcmCacheKey >(1, key), &out);
+		write_chunk("pcm0", data, &out);
+		if (!out) {
+			std::cerr << "WARNING: failed to write cache file '" << temp_file << "'." << std::endl;
+			out.close();
+			std::remove(temp_file.c_str());
+			return;
+		}
+	}
+	std::remove(cache_file.c_str()); //(rename won't replace an existing file on windows)
+	if (std::rename(temp_file.c_str(), cache_file.c_str()) != 0) {
+		//(not a problem if another writer got there first)
+		if (!std::ifstream(cache_file, std::ios::binary)) {
+			std::cerr << "WARNING: failed to move cache file into place as '" << cache_file << "'." << std::endl;
+		}
+		std::remove(temp_file.c_str());
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+//Cache of decoded audio, so sound files don't need to be decoded again every launch.
+//
+//Decoded data is stored (as read_write_chunk.hpp-style chunks) in the cache directory,
+// keyed by a hash of the source file's contents and a string naming the decoder and its settings,
+// so editing a file or changing how it is decoded makes a fresh entry.
+
+//Load 'filename' using 'load' (e.g., load_wav), unless a cached copy of its output exists.
+// 'decoder' names the loader and any settings that affect its output (e.g., "wav f32 mono 48000Hz").
+// Problems with the cache itself only produce warnings -- the file is then just decoded normally.
+void load_pcm_cached(
+	std::string const &filename,
+	std::string const &decoder,
+	void (*load)(std::string const &filename, std::vector< float > *data),
+	std::vector< float > *data
+);
+
+//Where cache files go (default: a per-user cache folder -- e.g., ~/.cache/game-pcm-cache -- or, failing that,
+// "pcm-cache" next to the executable); set to "" to turn the cache off.
+// (if the directory can't be created or written, the cache is turned off with a warning)
+void set_pcm_cache_directory(std::string const &directory);
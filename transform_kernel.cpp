@@ -0,0 +1,612 @@
+#include "transform_kernel.hpp"
+#include "cpu_features.hpp"
+
+#include <algorithm>
+
+//------------------------ scalar --------------------------------
+//(the SIMD versions below use these for leftover records, so they must match the SIMD arithmetic step-for-step)
+
+static inline void local_matrices_one(float const *p, float const *q, float const *s, float *l2p, float *p2l) {
+	//rotation matrix, as glm::mat3_cast computes it (r[c*3+r] is column c, row r):
+	float xx = q[0] * q[0], yy = q[1] * q[1], zz = q[2] * q[2];
+	float xy = q[0] * q[1], xz = q[0] * q[2], yz = q[1] * q[2];
+	float wx = q[3] * q[0], wy = q[3] * q[1], wz = q[3] * q[2];
+	float r[9] = {
+		1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy),
+		2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx),
+		2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy)
+	};
+
+	//compute:
+	//   translate   *   rotate    *   scale
+	// [ 1 0 0 p.x ]   [       0 ]   [ s.x 0 0 0 ]
+	// [ 0 1 0 p.y ] * [ rot   0 ] * [ 0 s.y 0 0 ]
+	// [ 0 0 1 p.z ]   [       0 ]   [ 0 0 s.z 0 ]
+	//                 [ 0 0 0 1 ]   [ 0 0   0 1 ]
+	for (uint32_t c = 0; c < 3; ++c) {
+		for (uint32_t row = 0; row < 3; ++row) {
+			l2p[c*3+row] = r[c*3+row] * s[c]; //scaling the columns here means that scale happens before rotation
+		}
+	}
+	l2p[9] = p[0]; l2p[10] = p[1]; l2p[11] = p[2];
+
+	//compute:
+	//   1/scale       *    rot^-1   *  translate^-1
+	// [ 1/s.x 0 0 0 ]   [       0 ]   [ 0 0 0 -p.x ]
+	// [ 0 1/s.y 0 0 ] * [rot^-1 0 ] * [ 0 0 0 -p.y ]
+	// [ 0 0 1/s.z 0 ]   [       0 ]   [ 0 0 0 -p.z ]
+	//                   [ 0 0 0 1 ]   [ 0 0 0  1   ]
+	// where rot^-1 is the transpose of rot (since rotation is a unit quaternion)
+	float inv_s[3];
+	for (uint32_t row = 0; row < 3; ++row) {
+		inv_s[row] = (s[row] == 0.0f ? 0.0f : 1.0f / s[row]);
+	}
+	for (uint32_t c = 0; c < 3; ++c) {
+		for (uint32_t row = 0; row < 3; ++row) {
+			p2l[c*3+row] = r[row*3+c] * inv_s[row];
+		}
+	}
+	for (uint32_t row = 0; row < 3; ++row) {
+		p2l[9+row] = -(p2l[row] * p[0] + p2l[3+row] * p[1] + p2l[6+row] * p[2]);
+	}
+}
+
+//out = a * b, treating both as affine (mat4x3 padded with 0 0 0 1):
+static inline void compose_one(float const *a, float const *b, float *out) {
+	for (uint32_t c = 0; c < 4; ++c) {
+		for (uint32_t row = 0; row < 3; ++row) {
+			float v = a[row] * b[c*3+0] + a[3+row] * b[c*3+1] + a[6+row] * b[c*3+2];
+			if (c == 3) v = v + a[9+row];
+			out[c*3+row] = v;
+		}
+	}
+}
+
+static inline void compose_record(uint32_t i, uint32_t const *parent, float const *local_to_parent, float const *parent_to_local, float *local_to_world, float *world_to_local) {
+	uint32_t p = parent[i];
+	if (p == -1U) {
+		std::copy(local_to_parent + 12*i, local_to_parent + 12*i + 12, local_to_world + 12*i);
+		std::copy(parent_to_local + 12*i, parent_to_local + 12*i + 12, world_to_local + 12*i);
+	} else {
+		compose_one(local_to_world + 12*p, local_to_parent + 12*i, local_to_world + 12*i);
+		compose_one(parent_to_local + 12*i, world_to_local + 12*p, world_to_local + 12*i);
+	}
+}
+
+static inline void draw_matrices_one(float const *clip, float const *light, float const *o, float *o2c, float *o2l, float *n2l) {
+	for (uint32_t c = 0; c < 4; ++c) {
+		for (uint32_t row = 0; row < 4; ++row) {
+			float v = clip[row] * o[c*3+0] + clip[4+row] * o[c*3+1] + clip[8+row] * o[c*3+2];
+			if (c == 3) v = v + clip[12+row];
+			o2c[c*4+row] = v;
+		}
+	}
+	compose_one(light, o, o2l);
+
+	//inverse transpose of a 3x3 matrix with columns a, b, c is (b x c, c x a, a x b) / det:
+	float const *a = o2l, *b = o2l + 3, *c = o2l + 6;
+	float n[9] = {
+		b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0],
+		c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0],
+		a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]
+	};
+	float det = a[0] * n[0] + a[1] * n[1] + a[2] * n[2];
+	float inv_det = (det == 0.0f ? 0.0f : 1.0f / det);
+	for (uint32_t k = 0; k < 9; ++k) {
+		n2l[k] = n[k] * inv_det;
+	}
+}
+
+static void local_matrices_scalar(uint32_t const *indices, uint32_t count, float const *position, float const *rotation, float const *scale, float *local_to_parent, float *parent_to_local) {
+	for (uint32_t k = 0; k < count; ++k) {
+		uint32_t i = indices[k];
+		local_matrices_one(position + 3*i, rotation + 4*i, scale + 3*i, local_to_parent + 12*i, parent_to_local + 12*i);
+	}
+}
+
+static void compose_scalar(uint32_t const *indices, uint32_t count, uint32_t const *parent, float const *local_to_parent, float const *parent_to_local, float *local_to_world, float *world_to_local) {
+	for (uint32_t k = 0; k < count; ++k) {
+		compose_record(indices[k], parent, local_to_parent, parent_to_local, local_to_world, world_to_local);
+	}
+}
+
+static void draw_matrices_scalar(float const world_to_clip[16], float const world_to_light[12], float const *object_to_world, uint32_t count, float *object_to_clip, float *object_to_light, float *normal_to_light) {
+	for (uint32_t k = 0; k < count; ++k) {
+		draw_matrices_one(world_to_clip, world_to_light, object_to_world + 12*k, object_to_clip + 16*k, object_to_light + 12*k, normal_to_light + 9*k);
+	}
+}
+
+#if CPU_X86
+
+//------------------------ SSE2 --------------------------------
+//(SSE2 is part of the x86-64 baseline, so this kernel is always available there)
+//Records are processed four at a time, one per lane: each is loaded and transposed so that
+// vector k holds float k of all four records, worked on, then transposed back and stored.
+
+//load floats [0, 4*groups) of four records (at base + stride * index[l]), as 4*groups vectors:
+static inline void load_records_sse2(float const *base, uint32_t stride, uint32_t const index[4], uint32_t groups, __m128 *v) {
+	for (uint32_t g = 0; g < groups; ++g) {
+		__m128 r0 = _mm_loadu_ps(base + stride * index[0] + 4*g);
+		__m128 r1 = _mm_loadu_ps(base + stride * index[1] + 4*g);
+		__m128 r2 = _mm_loadu_ps(base + stride * index[2] + 4*g);
+		__m128 r3 = _mm_loadu_ps(base + stride * index[3] + 4*g);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		v[4*g+0] = r0; v[4*g+1] = r1; v[4*g+2] = r2; v[4*g+3] = r3;
+	}
+}
+
+//load a vec3 from each of four records:
+static inline void load_vec3s_sse2(float const *base, uint32_t const index[4], __m128 *v) {
+	for (uint32_t k = 0; k < 3; ++k) {
+		v[k] = _mm_setr_ps(base[3*index[0]+k], base[3*index[1]+k], base[3*index[2]+k], base[3*index[3]+k]);
+	}
+}
+
+//store floats [0, 4*groups) of four records:
+static inline void store_records_sse2(__m128 const *v, uint32_t groups, float *base, uint32_t stride, uint32_t const index[4]) {
+	for (uint32_t g = 0; g < groups; ++g) {
+		__m128 r0 = v[4*g+0], r1 = v[4*g+1], r2 = v[4*g+2], r3 = v[4*g+3];
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_storeu_ps(base + stride * index[0] + 4*g, r0);
+		_mm_storeu_ps(base + stride * index[1] + 4*g, r1);
+		_mm_storeu_ps(base + stride * index[2] + 4*g, r2);
+		_mm_storeu_ps(base + stride * index[3] + 4*g, r3);
+	}
+}
+
+//a0 * b0 + a1 * b1 + a2 * b2 (one entry of a matrix product):
+static inline __m128 dot3_sse2(__m128 a0, __m128 a1, __m128 a2, __m128 b0, __m128 b1, __m128 b2) {
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, b0), _mm_mul_ps(a1, b1)), _mm_mul_ps(a2, b2));
+}
+
+//out = a * b (as compose_one):
+static inline void compose_lanes_sse2(__m128 const *a, __m128 const *b, __m128 *out) {
+	out[0] = dot3_sse2(a[0], a[3], a[6], b[0], b[1], b[2]);
+	out[1] = dot3_sse2(a[1], a[4], a[7], b[0], b[1], b[2]);
+	out[2] = dot3_sse2(a[2], a[5], a[8], b[0], b[1], b[2]);
+	out[3] = dot3_sse2(a[0], a[3], a[6], b[3], b[4], b[5]);
+	out[4] = dot3_sse2(a[1], a[4], a[7], b[3], b[4], b[5]);
+	out[5] = dot3_sse2(a[2], a[5], a[8], b[3], b[4], b[5]);
+	out[6] = dot3_sse2(a[0], a[3], a[6], b[6], b[7], b[8]);
+	out[7] = dot3_sse2(a[1], a[4], a[7], b[6], b[7], b[8]);
+	out[8] = dot3_sse2(a[2], a[5], a[8], b[6], b[7], b[8]);
+	out[9] = _mm_add_ps(dot3_sse2(a[0], a[3], a[6], b[9], b[10], b[11]), a[9]);
+	out[10] = _mm_add_ps(dot3_sse2(a[1], a[4], a[7], b[9], b[10], b[11]), a[10]);
+	out[11] = _mm_add_ps(dot3_sse2(a[2], a[5], a[8], b[9], b[10], b[11]), a[11]);
+}
+
+static void local_matrices_sse2(uint32_t const *indices, uint32_t count, float const *position, float const *rotation, float const *scale, float *local_to_parent, float *parent_to_local) {
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const two = _mm_set1_ps(2.0f);
+	__m128 const negate = _mm_set1_ps(-0.0f); //(xor with this flips the sign bit)
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 q[4], p[3], s[3];
+		load_records_sse2(rotation, 4, indices + k, 1, q);
+		load_vec3s_sse2(position, indices + k, p);
+		load_vec3s_sse2(scale, indices + k, s);
+
+		__m128 xx = _mm_mul_ps(q[0], q[0]), yy = _mm_mul_ps(q[1], q[1]), zz = _mm_mul_ps(q[2], q[2]);
+		__m128 xy = _mm_mul_ps(q[0], q[1]), xz = _mm_mul_ps(q[0], q[2]), yz = _mm_mul_ps(q[1], q[2]);
+		__m128 wx = _mm_mul_ps(q[3], q[0]), wy = _mm_mul_ps(q[3], q[1]), wz = _mm_mul_ps(q[3], q[2]);
+		__m128 r[9] = {
+			_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), _mm_mul_ps(two, _mm_add_ps(xy, wz)), _mm_mul_ps(two, _mm_sub_ps(xz, wy)),
+			_mm_mul_ps(two, _mm_sub_ps(xy, wz)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), _mm_mul_ps(two, _mm_add_ps(yz, wx)),
+			_mm_mul_ps(two, _mm_add_ps(xz, wy)), _mm_mul_ps(two, _mm_sub_ps(yz, wx)), _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)))
+		};
+
+		__m128 l2p[12];
+		l2p[0] = _mm_mul_ps(r[0], s[0]);
+		l2p[1] = _mm_mul_ps(r[1], s[0]);
+		l2p[2] = _mm_mul_ps(r[2], s[0]);
+		l2p[3] = _mm_mul_ps(r[3], s[1]);
+		l2p[4] = _mm_mul_ps(r[4], s[1]);
+		l2p[5] = _mm_mul_ps(r[5], s[1]);
+		l2p[6] = _mm_mul_ps(r[6], s[2]);
+		l2p[7] = _mm_mul_ps(r[7], s[2]);
+		l2p[8] = _mm_mul_ps(r[8], s[2]);
+		l2p[9] = p[0]; l2p[10] = p[1]; l2p[11] = p[2];
+		store_records_sse2(l2p, 3, local_to_parent, 12, indices + k);
+
+		__m128 inv_s[3];
+		for (uint32_t row = 0; row < 3; ++row) {
+			inv_s[row] = _mm_andnot_ps(_mm_cmpeq_ps(s[row], _mm_setzero_ps()), _mm_div_ps(one, s[row]));
+		}
+		__m128 p2l[12];
+		p2l[0] = _mm_mul_ps(r[0], inv_s[0]);
+		p2l[1] = _mm_mul_ps(r[3], inv_s[1]);
+		p2l[2] = _mm_mul_ps(r[6], inv_s[2]);
+		p2l[3] = _mm_mul_ps(r[1], inv_s[0]);
+		p2l[4] = _mm_mul_ps(r[4], inv_s[1]);
+		p2l[5] = _mm_mul_ps(r[7], inv_s[2]);
+		p2l[6] = _mm_mul_ps(r[2], inv_s[0]);
+		p2l[7] = _mm_mul_ps(r[5], inv_s[1]);
+		p2l[8] = _mm_mul_ps(r[8], inv_s[2]);
+		p2l[9] = _mm_xor_ps(dot3_sse2(p2l[0], p2l[3], p2l[6], p[0], p[1], p[2]), negate);
+		p2l[10] = _mm_xor_ps(dot3_sse2(p2l[1], p2l[4], p2l[7], p[0], p[1], p[2]), negate);
+		p2l[11] = _mm_xor_ps(dot3_sse2(p2l[2], p2l[5], p2l[8], p[0], p[1], p[2]), negate);
+		store_records_sse2(p2l, 3, parent_to_local, 12, indices + k);
+	}
+	if (k < count) local_matrices_scalar(indices + k, count - k, position, rotation, scale, local_to_parent, parent_to_local);
+}
+
+//compose four records, none of which is another's parent:
+static inline void compose_group_sse2(uint32_t const index[4], uint32_t const *parent, float const *local_to_parent, float const *parent_to_local, float *local_to_world, float *world_to_local) {
+	//records without a parent read record 0 in its place, then keep their local matrices instead of the product:
+	uint32_t parent_index[4];
+	for (uint32_t l = 0; l < 4; ++l) {
+		parent_index[l] = (parent[index[l]] == -1U ? 0 : parent[index[l]]);
+	}
+	__m128 root = _mm_castsi128_ps(_mm_cmpeq_epi32(
+		_mm_setr_epi32(int32_t(parent[index[0]]), int32_t(parent[index[1]]), int32_t(parent[index[2]]), int32_t(parent[index[3]])),
+		_mm_set1_epi32(-1)
+	));
+
+	__m128 local[12], world[12], result[12];
+	load_records_sse2(local_to_parent, 12, index, 3, local);
+	load_records_sse2(local_to_world, 12, parent_index, 3, world);
+	compose_lanes_sse2(world, local, result);
+	for (uint32_t j = 0; j < 12; ++j) {
+		result[j] = _mm_or_ps(_mm_and_ps(root, local[j]), _mm_andnot_ps(root, result[j]));
+	}
+	store_records_sse2(result, 3, local_to_world, 12, index);
+
+	load_records_sse2(parent_to_local, 12, index, 3, local);
+	load_records_sse2(world_to_local, 12, parent_index, 3, world);
+	compose_lanes_sse2(local, world, result);
+	for (uint32_t j = 0; j < 12; ++j) {
+		result[j] = _mm_or_ps(_mm_and_ps(root, local[j]), _mm_andnot_ps(root, result[j]));
+	}
+	store_records_sse2(result, 3, world_to_local, 12, index);
+}
+
+//can records indices[0 .. lanes) be composed together? (only if none of their parents is among them)
+static inline bool independent(uint32_t const *indices, uint32_t lanes, uint32_t const *parent) {
+	for (uint32_t l = 0; l < lanes; ++l) {
+		uint32_t p = parent[indices[l]];
+		if (p != -1U && p >= indices[0]) return false;
+	}
+	return true;
+}
+
+static void compose_sse2(uint32_t const *indices, uint32_t count, uint32_t const *parent, float const *local_to_parent, float const *parent_to_local, float *local_to_world, float *world_to_local) {
+	uint32_t k = 0;
+	while (k + 4 <= count) {
+		if (independent(indices + k, 4, parent)) {
+			compose_group_sse2(indices + k, parent, local_to_parent, parent_to_local, local_to_world, world_to_local);
+			k += 4;
+		} else {
+			compose_record(indices[k], parent, local_to_parent, parent_to_local, local_to_world, world_to_local);
+			k += 1;
+		}
+	}
+	if (k < count) compose_scalar(indices + k, count - k, parent, local_to_parent, parent_to_local, local_to_world, world_to_local);
+}
+
+//one component of a cross product, u1 * v1 - u2 * v2:
+static inline __m128 cross_sse2(__m128 u1, __m128 u2, __m128 v1, __m128 v2) {
+	return _mm_sub_ps(_mm_mul_ps(u1, v1), _mm_mul_ps(u2, v2));
+}
+
+static void draw_matrices_sse2(float const world_to_clip[16], float const world_to_light[12], float const *object_to_world, uint32_t count, float *object_to_clip, float *object_to_light, float *normal_to_light) {
+	__m128 clip[16], light[12];
+	for (uint32_t j = 0; j < 16; ++j) clip[j] = _mm_set1_ps(world_to_clip[j]);
+	for (uint32_t j = 0; j < 12; ++j) light[j] = _mm_set1_ps(world_to_light[j]);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		uint32_t const index[4] = { k, k + 1, k + 2, k + 3 };
+		__m128 o[12];
+		load_records_sse2(object_to_world, 12, index, 3, o);
+
+		__m128 o2c[16];
+		o2c[0] = dot3_sse2(clip[0], clip[4], clip[8], o[0], o[1], o[2]);
+		o2c[1] = dot3_sse2(clip[1], clip[5], clip[9], o[0], o[1], o[2]);
+		o2c[2] = dot3_sse2(clip[2], clip[6], clip[10], o[0], o[1], o[2]);
+		o2c[3] = dot3_sse2(clip[3], clip[7], clip[11], o[0], o[1], o[2]);
+		o2c[4] = dot3_sse2(clip[0], clip[4], clip[8], o[3], o[4], o[5]);
+		o2c[5] = dot3_sse2(clip[1], clip[5], clip[9], o[3], o[4], o[5]);
+		o2c[6] = dot3_sse2(clip[2], clip[6], clip[10], o[3], o[4], o[5]);
+		o2c[7] = dot3_sse2(clip[3], clip[7], clip[11], o[3], o[4], o[5]);
+		o2c[8] = dot3_sse2(clip[0], clip[4], clip[8], o[6], o[7], o[8]);
+		o2c[9] = dot3_sse2(clip[1], clip[5], clip[9], o[6], o[7], o[8]);
+		o2c[10] = dot3_sse2(clip[2], clip[6], clip[10], o[6], o[7], o[8]);
+		o2c[11] = dot3_sse2(clip[3], clip[7], clip[11], o[6], o[7], o[8]);
+		o2c[12] = _mm_add_ps(dot3_sse2(clip[0], clip[4], clip[8], o[9], o[10], o[11]), clip[12]);
+		o2c[13] = _mm_add_ps(dot3_sse2(clip[1], clip[5], clip[9], o[9], o[10], o[11]), clip[13]);
+		o2c[14] = _mm_add_ps(dot3_sse2(clip[2], clip[6], clip[10], o[9], o[10], o[11]), clip[14]);
+		o2c[15] = _mm_add_ps(dot3_sse2(clip[3], clip[7], clip[11], o[9], o[10], o[11]), clip[15]);
+		store_records_sse2(o2c, 4, object_to_clip, 16, index);
+
+		__m128 o2l[12];
+		compose_lanes_sse2(light, o, o2l);
+		store_records_sse2(o2l, 3, object_to_light, 12, index);
+
+		__m128 const *a = o2l, *b = o2l + 3, *c = o2l + 6;
+		__m128 n[9] = {
+			cross_sse2(b[1], b[2], c[2], c[1]), cross_sse2(b[2], b[0], c[0], c[2]), cross_sse2(b[0], b[1], c[1], c[0]),
+			cross_sse2(c[1], c[2], a[2], a[1]), cross_sse2(c[2], c[0], a[0], a[2]), cross_sse2(c[0], c[1], a[1], a[0]),
+			cross_sse2(a[1], a[2], b[2], b[1]), cross_sse2(a[2], a[0], b[0], b[2]), cross_sse2(a[0], a[1], b[1], b[0])
+		};
+		__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], n[0]), _mm_mul_ps(a[1], n[1])), _mm_mul_ps(a[2], n[2]));
+		__m128 inv_det = _mm_andnot_ps(_mm_cmpeq_ps(det, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), det));
+		for (uint32_t j = 0; j < 9; ++j) n[j] = _mm_mul_ps(n[j], inv_det);
+		//(nine floats per record, so the last is stored one lane at a time)
+		store_records_sse2(n, 2, normal_to_light, 9, index);
+		float last[4];
+		_mm_storeu_ps(last, n[8]);
+		for (uint32_t l = 0; l < 4; ++l) normal_to_light[9*(k+l)+8] = last[l];
+	}
+	if (k < count) draw_matrices_scalar(world_to_clip, world_to_light, object_to_world + 12*k, count - k, object_to_clip + 16*k, object_to_light + 12*k, normal_to_light + 9*k);
+}
+
+//------------------------ AVX2 --------------------------------
+//As with SSE2, but eight records at a time.
+//(records are loaded four floats at a time and transposed, which is much faster than gathering a float at a time;
+// only vec3s, where a four-float load could run off the end of the array, are gathered)
+
+//load floats [0, 4*groups) of eight records (at base + stride * index[l]), as 4*groups vectors:
+CPU_TARGET_AVX2
+static inline void load_records_avx2(float const *base, uint32_t stride, uint32_t const index[8], uint32_t groups, __m256 *v) {
+	for (uint32_t g = 0; g < groups; ++g) {
+		//floats 4g..4g+3 of record l in the low half, and of record l + 4 in the high half:
+		__m256 r[4];
+		for (uint32_t l = 0; l < 4; ++l) {
+			r[l] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(base + stride * index[l] + 4*g)), _mm_loadu_ps(base + stride * index[l+4] + 4*g), 1);
+		}
+		//transpose within each 128-bit half (the inverse of store_records_avx2):
+		__m256 t0 = _mm256_unpacklo_ps(r[0], r[1]);
+		__m256 t1 = _mm256_unpackhi_ps(r[0], r[1]);
+		__m256 t2 = _mm256_unpacklo_ps(r[2], r[3]);
+		__m256 t3 = _mm256_unpackhi_ps(r[2], r[3]);
+		v[4*g+0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0));
+		v[4*g+1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+		v[4*g+2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0));
+		v[4*g+3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+	}
+}
+
+//load a vec3 from each of eight records:
+CPU_TARGET_AVX2
+static inline void load_vec3s_avx2(float const *base, uint32_t const index[8], __m256 *v) {
+	__m256i offset = _mm256_mullo_epi32(_mm256_loadu_si256(reinterpret_cast< __m256i const * >(index)), _mm256_set1_epi32(3));
+	for (uint32_t k = 0; k < 3; ++k) {
+		v[k] = _mm256_i32gather_ps(base + k, offset, 4);
+	}
+}
+
+//store floats [0, 4*groups) of eight records:
+CPU_TARGET_AVX2
+static inline void store_records_avx2(__m256 const *v, uint32_t groups, float *base, uint32_t stride, uint32_t const index[8]) {
+	for (uint32_t g = 0; g < groups; ++g) {
+		//transpose within each 128-bit half, so lane l of the low half (and of the high half) holds floats 4g..4g+3 of record l (and of record l + 4):
+		__m256 t0 = _mm256_unpacklo_ps(v[4*g+0], v[4*g+1]);
+		__m256 t1 = _mm256_unpackhi_ps(v[4*g+0], v[4*g+1]);
+		__m256 t2 = _mm256_unpacklo_ps(v[4*g+2], v[4*g+3]);
+		__m256 t3 = _mm256_unpackhi_ps(v[4*g+2], v[4*g+3]);
+		__m256 r[4] = {
+			_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0)),
+			_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2)),
+			_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0)),
+			_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2))
+		};
+		for (uint32_t l = 0; l < 4; ++l) {
+			_mm_storeu_ps(base + stride * index[l] + 4*g, _mm256_castps256_ps128(r[l]));
+			_mm_storeu_ps(base + stride * index[l+4] + 4*g, _mm256_extractf128_ps(r[l], 1));
+		}
+	}
+}
+
+//a0 * b0 + a1 * b1 + a2 * b2 (one entry of a matrix product):
+CPU_TARGET_AVX2
+static inline __m256 dot3_avx2(__m256 a0, __m256 a1, __m256 a2, __m256 b0, __m256 b1, __m256 b2) {
+	return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a0, b0), _mm256_mul_ps(a1, b1)), _mm256_mul_ps(a2, b2));
+}
+
+CPU_TARGET_AVX2
+static inline void compose_lanes_avx2(__m256 const *a, __m256 const *b, __m256 *out) {
+	out[0] = dot3_avx2(a[0], a[3], a[6], b[0], b[1], b[2]);
+	out[1] = dot3_avx2(a[1], a[4], a[7], b[0], b[1], b[2]);
+	out[2] = dot3_avx2(a[2], a[5], a[8], b[0], b[1], b[2]);
+	out[3] = dot3_avx2(a[0], a[3], a[6], b[3], b[4], b[5]);
+	out[4] = dot3_avx2(a[1], a[4], a[7], b[3], b[4], b[5]);
+	out[5] = dot3_avx2(a[2], a[5], a[8], b[3], b[4], b[5]);
+	out[6] = dot3_avx2(a[0], a[3], a[6], b[6], b[7], b[8]);
+	out[7] = dot3_avx2(a[1], a[4], a[7], b[6], b[7], b[8]);
+	out[8] = dot3_avx2(a[2], a[5], a[8], b[6], b[7], b[8]);
+	out[9] = _mm256_add_ps(dot3_avx2(a[0], a[3], a[6], b[9], b[10], b[11]), a[9]);
+	out[10] = _mm256_add_ps(dot3_avx2(a[1], a[4], a[7], b[9], b[10], b[11]), a[10]);
+	out[11] = _mm256_add_ps(dot3_avx2(a[2], a[5], a[8], b[9], b[10], b[11]), a[11]);
+}
+
+CPU_TARGET_AVX2
+static void local_matrices_avx2(uint32_t const *indices, uint32_t count, float const *position, float const *rotation, float const *scale, float *local_to_parent, float *parent_to_local) {
+	__m256 const one = _mm256_set1_ps(1.0f);
+	__m256 const two = _mm256_set1_ps(2.0f);
+	__m256 const negate = _mm256_set1_ps(-0.0f); //(xor with this flips the sign bit)
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 q[4], p[3], s[3];
+		load_records_avx2(rotation, 4, indices + k, 1, q);
+		load_vec3s_avx2(position, indices + k, p);
+		load_vec3s_avx2(scale, indices + k, s);
+
+		__m256 xx = _mm256_mul_ps(q[0], q[0]), yy = _mm256_mul_ps(q[1], q[1]), zz = _mm256_mul_ps(q[2], q[2]);
+		__m256 xy = _mm256_mul_ps(q[0], q[1]), xz = _mm256_mul_ps(q[0], q[2]), yz = _mm256_mul_ps(q[1], q[2]);
+		__m256 wx = _mm256_mul_ps(q[3], q[0]), wy = _mm256_mul_ps(q[3], q[1]), wz = _mm256_mul_ps(q[3], q[2]);
+		__m256 r[9] = {
+			_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), _mm256_mul_ps(two, _mm256_add_ps(xy, wz)), _mm256_mul_ps(two, _mm256_sub_ps(xz, wy)),
+			_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), _mm256_mul_ps(two, _mm256_add_ps(yz, wx)),
+			_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), _mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), _mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy)))
+		};
+
+		__m256 l2p[12];
+		l2p[0] = _mm256_mul_ps(r[0], s[0]);
+		l2p[1] = _mm256_mul_ps(r[1], s[0]);
+		l2p[2] = _mm256_mul_ps(r[2], s[0]);
+		l2p[3] = _mm256_mul_ps(r[3], s[1]);
+		l2p[4] = _mm256_mul_ps(r[4], s[1]);
+		l2p[5] = _mm256_mul_ps(r[5], s[1]);
+		l2p[6] = _mm256_mul_ps(r[6], s[2]);
+		l2p[7] = _mm256_mul_ps(r[7], s[2]);
+		l2p[8] = _mm256_mul_ps(r[8], s[2]);
+		l2p[9] = p[0]; l2p[10] = p[1]; l2p[11] = p[2];
+		store_records_avx2(l2p, 3, local_to_parent, 12, indices + k);
+
+		__m256 inv_s[3];
+		for (uint32_t row = 0; row < 3; ++row) {
+			inv_s[row] = _mm256_andnot_ps(_mm256_cmp_ps(s[row], _mm256_setzero_ps(), _CMP_EQ_OQ), _mm256_div_ps(one, s[row]));
+		}
+		__m256 p2l[12];
+		p2l[0] = _mm256_mul_ps(r[0], inv_s[0]);
+		p2l[1] = _mm256_mul_ps(r[3], inv_s[1]);
+		p2l[2] = _mm256_mul_ps(r[6], inv_s[2]);
+		p2l[3] = _mm256_mul_ps(r[1], inv_s[0]);
+		p2l[4] = _mm256_mul_ps(r[4], inv_s[1]);
+		p2l[5] = _mm256_mul_ps(r[7], inv_s[2]);
+		p2l[6] = _mm256_mul_ps(r[2], inv_s[0]);
+		p2l[7] = _mm256_mul_ps(r[5], inv_s[1]);
+		p2l[8] = _mm256_mul_ps(r[8], inv_s[2]);
+		p2l[9] = _mm256_xor_ps(dot3_avx2(p2l[0], p2l[3], p2l[6], p[0], p[1], p[2]), negate);
+		p2l[10] = _mm256_xor_ps(dot3_avx2(p2l[1], p2l[4], p2l[7], p[0], p[1], p[2]), negate);
+		p2l[11] = _mm256_xor_ps(dot3_avx2(p2l[2], p2l[5], p2l[8], p[0], p[1], p[2]), negate);
+		store_records_avx2(p2l, 3, parent_to_local, 12, indices + k);
+	}
+	if (k < count) local_matrices_sse2(indices + k, count - k, position, rotation, scale, local_to_parent, parent_to_local);
+}
+
+CPU_TARGET_AVX2
+static inline void compose_group_avx2(uint32_t const index[8], uint32_t const *parent, float const *local_to_parent, float const *parent_to_local, float *local_to_world, float *world_to_local) {
+	uint32_t parent_index[8];
+	int32_t parent_raw[8];
+	for (uint32_t l = 0; l < 8; ++l) {
+		parent_index[l] = (parent[index[l]] == -1U ? 0 : parent[index[l]]);
+		parent_raw[l] = int32_t(parent[index[l]]);
+	}
+	__m256 root = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast< __m256i const * >(parent_raw)), _mm256_set1_epi32(-1)));
+
+	__m256 local[12], world[12], result[12];
+	load_records_avx2(local_to_parent, 12, index, 3, local);
+	load_records_avx2(local_to_world, 12, parent_index, 3, world);
+	compose_lanes_avx2(world, local, result);
+	for (uint32_t j = 0; j < 12; ++j) {
+		result[j] = _mm256_blendv_ps(result[j], local[j], root);
+	}
+	store_records_avx2(result, 3, local_to_world, 12, index);
+
+	load_records_avx2(parent_to_local, 12, index, 3, local);
+	load_records_avx2(world_to_local, 12, parent_index, 3, world);
+	compose_lanes_avx2(local, world, result);
+	for (uint32_t j = 0; j < 12; ++j) {
+		result[j] = _mm256_blendv_ps(result[j], local[j], root);
+	}
+	store_records_avx2(result, 3, world_to_local, 12, index);
+}
+
+CPU_TARGET_AVX2
+static void compose_avx2(uint32_t const *indices, uint32_t count, uint32_t const *parent, float const *local_to_parent, float const *parent_to_local, float *local_to_world, float *world_to_local) {
+	uint32_t k = 0;
+	while (k + 4 <= count) {
+		//try eight records at once, then four, then one:
+		if (k + 8 <= count && independent(indices + k, 8, parent)) {
+			compose_group_avx2(indices + k, parent, local_to_parent, parent_to_local, local_to_world, world_to_local);
+			k += 8;
+		} else if (independent(indices + k, 4, parent)) {
+			compose_group_sse2(indices + k, parent, local_to_parent, parent_to_local, local_to_world, world_to_local);
+			k += 4;
+		} else {
+			compose_record(indices[k], parent, local_to_parent, parent_to_local, local_to_world, world_to_local);
+			k += 1;
+		}
+	}
+	if (k < count) compose_scalar(indices + k, count - k, parent, local_to_parent, parent_to_local, local_to_world, world_to_local);
+}
+
+CPU_TARGET_AVX2
+static inline __m256 cross_avx2(__m256 u1, __m256 u2, __m256 v1, __m256 v2) {
+	return _mm256_sub_ps(_mm256_mul_ps(u1, v1), _mm256_mul_ps(u2, v2));
+}
+
+CPU_TARGET_AVX2
+static void draw_matrices_avx2(float const world_to_clip[16], float const world_to_light[12], float const *object_to_world, uint32_t count, float *object_to_clip, float *object_to_light, float *normal_to_light) {
+	__m256 clip[16], light[12];
+	for (uint32_t j = 0; j < 16; ++j) clip[j] = _mm256_set1_ps(world_to_clip[j]);
+	for (uint32_t j = 0; j < 12; ++j) light[j] = _mm256_set1_ps(world_to_light[j]);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		uint32_t const index[8] = { k, k + 1, k + 2, k + 3, k + 4, k + 5, k + 6, k + 7 };
+		__m256 o[12];
+		load_records_avx2(object_to_world, 12, index, 3, o);
+
+		__m256 o2c[16];
+		o2c[0] = dot3_avx2(clip[0], clip[4], clip[8], o[0], o[1], o[2]);
+		o2c[1] = dot3_avx2(clip[1], clip[5], clip[9], o[0], o[1], o[2]);
+		o2c[2] = dot3_avx2(clip[2], clip[6], clip[10], o[0], o[1], o[2]);
+		o2c[3] = dot3_avx2(clip[3], clip[7], clip[11], o[0], o[1], o[2]);
+		o2c[4] = dot3_avx2(clip[0], clip[4], clip[8], o[3], o[4], o[5]);
+		o2c[5] = dot3_avx2(clip[1], clip[5], clip[9], o[3], o[4], o[5]);
+		o2c[6] = dot3_avx2(clip[2], clip[6], clip[10], o[3], o[4], o[5]);
+		o2c[7] = dot3_avx2(clip[3], clip[7], clip[11], o[3], o[4], o[5]);
+		o2c[8] = dot3_avx2(clip[0], clip[4], clip[8], o[6], o[7], o[8]);
+		o2c[9] = dot3_avx2(clip[1], clip[5], clip[9], o[6], o[7], o[8]);
+		o2c[10] = dot3_avx2(clip[2], clip[6], clip[10], o[6], o[7], o[8]);
+		o2c[11] = dot3_avx2(clip[3], clip[7], clip[11], o[6], o[7], o[8]);
+		o2c[12] = _mm256_add_ps(dot3_avx2(clip[0], clip[4], clip[8], o[9], o[10], o[11]), clip[12]);
+		o2c[13] = _mm256_add_ps(dot3_avx2(clip[1], clip[5], clip[9], o[9], o[10], o[11]), clip[13]);
+		o2c[14] = _mm256_add_ps(dot3_avx2(clip[2], clip[6], clip[10], o[9], o[10], o[11]), clip[14]);
+		o2c[15] = _mm256_add_ps(dot3_avx2(clip[3], clip[7], clip[11], o[9], o[10], o[11]), clip[15]);
+		store_records_avx2(o2c, 4, object_to_clip, 16, index);
+
+		__m256 o2l[12];
+		compose_lanes_avx2(light, o, o2l);
+		store_records_avx2(o2l, 3, object_to_light, 12, index);
+
+		__m256 const *a = o2l, *b = o2l + 3, *c = o2l + 6;
+		__m256 n[9] = {
+			cross_avx2(b[1], b[2], c[2], c[1]), cross_avx2(b[2], b[0], c[0], c[2]), cross_avx2(b[0], b[1], c[1], c[0]),
+			cross_avx2(c[1], c[2], a[2], a[1]), cross_avx2(c[2], c[0], a[0], a[2]), cross_avx2(c[0], c[1], a[1], a[0]),
+			cross_avx2(a[1], a[2], b[2], b[1]), cross_avx2(a[2], a[0], b[0], b[2]), cross_avx2(a[0], a[1], b[1], b[0])
+		};
+		__m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a[0], n[0]), _mm256_mul_ps(a[1], n[1])), _mm256_mul_ps(a[2], n[2]));
+		__m256 inv_det = _mm256_andnot_ps(_mm256_cmp_ps(det, _mm256_setzero_ps(), _CMP_EQ_OQ), _mm256_div_ps(_mm256_set1_ps(1.0f), det));
+		for (uint32_t j = 0; j < 9; ++j) n[j] = _mm256_mul_ps(n[j], inv_det);
+		store_records_avx2(n, 2, normal_to_light, 9, index);
+		float last[8];
+		_mm256_storeu_ps(last, n[8]);
+		for (uint32_t l = 0; l < 8; ++l) normal_to_light[9*(k+l)+8] = last[l];
+	}
+	if (k < count) draw_matrices_sse2(world_to_clip, world_to_light, object_to_world + 12*k, count - k, object_to_clip + 16*k, object_to_light + 12*k, normal_to_light + 9*k);
+}
+
+#endif //CPU_X86
+
+//------------------------ public-facing --------------------------------
+
+std::vector< TransformKernel > const &get_supported_transform_kernels() {
+	static std::vector< TransformKernel > kernels = [](){
+		std::vector< TransformKernel > ret;
+		ret.emplace_back(TransformKernel{"scalar", local_matrices_scalar, compose_scalar, draw_matrices_scalar});
+		#if CPU_X86
+		ret.emplace_back(TransformKernel{"sse2", local_matrices_sse2, compose_sse2, draw_matrices_sse2});
+		if (cpu_has_avx2()) {
+			ret.emplace_back(TransformKernel{"avx2", local_matrices_avx2, compose_avx2, draw_matrices_avx2});
+		}
+		#endif
+		return ret;
+	}();
+	return kernels;
+}
+
+TransformKernel const &get_transform_kernel() {
+	static TransformKernel const best = [](){
+		TransformKernel ret = get_supported_transform_kernels().back();
+		#if CPU_X86
+		//draw_matrices writes 148 bytes per object and so is limited by memory traffic rather than arithmetic;
+		// in bench-transforms the AVX2 version is no faster than the SSE2 version (and used to be slower), so use SSE2's:
+		ret.draw_matrices = draw_matrices_sse2;
+		#endif
+		return ret;
+	}();
+	return best;
+}
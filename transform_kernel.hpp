@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * Batch matrix math for Scene (used by Scene::TransformStore and Scene::draw).
+ *
+ * Matrices are stored as plain floats in column-major order, as glm stores them:
+ *  12 floats for a mat4x3 (an affine transform; the missing row is 0 0 0 1),
+ *  16 for a mat4, 9 for a mat3.
+ * Rotations are quaternions stored x,y,z,w (glm's layout), and are assumed to be
+ *  of unit length.
+ *
+ * Kernels work on whole arrays of records, so SIMD versions can process
+ *  several records at once (one per vector lane). Every version does the same
+ *  arithmetic in the same order for each record, so all versions -- and any
+ *  grouping of records into calls -- give bit-identical results.
+ *
+ * Several versions (scalar, SSE2, AVX2) exist; get_transform_kernel() picks, for
+ *  each function, the fastest one the running CPU supports (this is not always
+ *  the widest: see get_transform_kernel() in transform_kernel.cpp).
+ *
+ */
+
+#include <cstdint>
+#include <vector>
+
+//build the matrices of the records 'indices[0 .. count)' from their position (3 floats), rotation (4), and scale (3):
+//  local_to_parent = translate(position) * rotate(rotation) * scale(scale)
+//  parent_to_local = scale(1 / scale) * rotate(rotation)^-1 * translate(-position)
+// (scale components of zero are inverted to zero, giving a degenerate matrix rather than NaN's)
+typedef void (*LocalMatricesFn)(
+	uint32_t const *indices, uint32_t count,
+	float const *position, float const *rotation, float const *scale,
+	float *local_to_parent, float *parent_to_local
+);
+
+//compute the world matrices of the records 'indices[0 .. count)', in order:
+//  local_to_world[i] = local_to_world[parent[i]] * local_to_parent[i]
+//  world_to_local[i] = parent_to_local[i] * world_to_local[parent[i]]
+// (or just a copy of local_to_parent / parent_to_local where parent[i] is -1U)
+// 'indices' must be increasing, and parent[i] < i, so a record's parent may be computed earlier in the same call.
+typedef void (*ComposeFn)(
+	uint32_t const *indices, uint32_t count,
+	uint32_t const *parent,
+	float const *local_to_parent, float const *parent_to_local,
+	float *local_to_world, float *world_to_local
+);
+
+//compute the matrices needed to draw 'count' objects:
+//  object_to_clip[k] = world_to_clip * object_to_world[k] (mat4)
+//  object_to_light[k] = world_to_light * object_to_world[k] (mat4x3)
+//  normal_to_light[k] = inverse(transpose(mat3(object_to_light[k]))) (mat3; zero if object_to_light[k] is degenerate)
+typedef void (*DrawMatricesFn)(
+	float const world_to_clip[16], float const world_to_light[12],
+	float const *object_to_world, uint32_t count,
+	float *object_to_clip, float *object_to_light, float *normal_to_light
+);
+
+struct TransformKernel {
+	char const *name; //for reporting, e.g. "avx2"
+	LocalMatricesFn local_matrices;
+	ComposeFn compose;
+	DrawMatricesFn draw_matrices;
+};
+
+//the best kernel for the running CPU (selected once, on first call):
+TransformKernel const &get_transform_kernel();
+
+//every kernel the running CPU can execute, slowest (scalar) first:
+// (useful for benchmarking and cross-checking kernels against each other)
+std::vector< TransformKernel > const &get_supported_transform_kernels();